@@ -6,6 +6,10 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #include <rdma/rdma_verbs.h>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <tuple>
 #include <utility>
 
 #include <spdlog/spdlog.h>
@@ -37,14 +41,14 @@ void resolve_addr(rdma_cm_id *id,
   freeaddrinfo(addr);
 }
 
-auto create_qp_attr() noexcept
+auto create_qp_attr(std::uint32_t const max_sge) noexcept
 {
   struct ibv_qp_init_attr qp_attr;
   memset(&qp_attr, 0, sizeof(qp_attr));
   qp_attr.qp_type = IBV_QPT_RC;
   qp_attr.cap.max_send_wr = 10000;// increase later
   qp_attr.cap.max_recv_wr = 10;
-  qp_attr.cap.max_send_sge = 1;
+  qp_attr.cap.max_send_sge = max_sge;
   qp_attr.cap.max_recv_sge = 1;
   qp_attr.sq_sig_all = 0;// shouldn't need this explicitly
 
@@ -76,7 +80,14 @@ void FAM::FamControl::RdmaServiceImpl::CreateConnection()
   if (event.event != RDMA_CM_EVENT_ADDR_RESOLVED)
     throw std::runtime_error("rdma_resolve_addr() failed!");
 
-  auto qp_attr = create_qp_attr();
+  struct ibv_device_attr device_attr;
+  if (ibv_query_device(id->verbs, &device_attr))
+    throw std::runtime_error("ibv_query_device() failed!");
+  auto const device_sge =
+    static_cast<std::uint32_t>(std::max(1, device_attr.max_sge_rd));
+  this->max_sge = std::min(this->max_sge, device_sge);
+
+  auto qp_attr = create_qp_attr(this->max_sge);
   create_qp(id, qp_attr);
   if (rdma_resolve_route(id, TIMEOUT_MS))
     throw std::runtime_error("rdma_resolve_route() failed!");
@@ -85,7 +96,10 @@ void FAM::FamControl::RdmaServiceImpl::CreateConnection()
   if (event2.event != RDMA_CM_EVENT_ROUTE_RESOLVED)
     throw std::runtime_error("rdma_resolve_addr() failed!");
 
-  auto params = FAM::rdma::RdmaConnParams();
+  // the server ties this connection to our session
+  auto params = FAM::rdma::RdmaConnParams(id->verbs);
+  params.private_data = &this->session_id;
+  params.private_data_len = sizeof(this->session_id);
   connect(id, params);
 
   auto event3 = get_event(chan);
@@ -103,146 +117,313 @@ std::pair<void *, uint32_t> FAM::FamControl::RdmaServiceImpl::CreateRegion(
   if (this->ids.size() == 0) throw std::runtime_error("No rdma_cm_id's to use");
   auto id = this->ids.front().get();
   this->regions.emplace_back(std::make_unique<FAM::rdma::RdmaMemoryBuffer>(
-    id, t_size, use_HP, write_allowed));
+    id->pd, t_size, use_HP, write_allowed));
   auto const p = this->regions.back()->p.get();
   auto const lkey = this->regions.back()->mr->lkey;
   return std::make_pair(p, lkey);
 }
 
+uint32_t FAM::FamControl::RdmaServiceImpl::RegisterRegion(void *addr,
+  std::uint64_t const t_size,
+  bool const write_allowed)
+{
+  if (this->ids.size() == 0) throw std::runtime_error("No rdma_cm_id's to use");
+  auto id = this->ids.front().get();
+  this->regions.emplace_back(std::make_unique<FAM::rdma::RdmaMemoryBuffer>(
+    id->pd, addr, t_size, write_allowed));
+  return this->regions.back()->mr->lkey;
+}
+
 struct FAM::IbWorkRequest
 {
   struct ibv_send_wr wr;
-  struct ibv_sge sge;
+  struct ibv_sge sge[FAM::max_scatter_entries];
 };
 
 FAM::FamControl::RdmaServiceImpl::RdmaServiceImpl(std::string const& t_host,
   std::string const& t_port,
-  int const channels)
-  : ec{ FAM::rdma::CreateEventChannel() }, host{ t_host }, port{ t_port }
+  int const channels,
+  std::uint64_t const t_session_id,
+  bool const t_io_thread)
+  : ec{ FAM::rdma::CreateEventChannel() }, host{ t_host }, port{ t_port },
+    posted(static_cast<std::size_t>(channels + t_io_thread), 0),
+    completed{ new std::atomic<std::uint64_t>[static_cast<std::size_t>(
+      channels + t_io_thread)] },
+    session_id{ t_session_id }
 {
-  for (int i = 0; i < channels; ++i) {
+  for (int i = 0; i < channels + t_io_thread; ++i) {
     this->CreateConnection();
-    this->wrs.emplace_back(std::unique_ptr<IbWorkRequest[]>(
-      new IbWorkRequest[FAM::max_outstanding_wr]));
+    auto ring = std::unique_ptr<IbWorkRequest[]>(
+      new IbWorkRequest[FAM::wr_ring_size]);
+    for (unsigned long k = 0; k < FAM::wr_ring_size; ++k) {
+      auto &[wr, sge] = ring[k];
+      memset(&wr, 0, sizeof(wr));
+      memset(&sge, 0, sizeof(sge));
+      wr.sg_list = sge;
+      wr.num_sge = 1;
+    }
+    this->wrs.push_back(std::move(ring));
+    this->completed[static_cast<std::size_t>(i)] = 0;
   }
+  this->discard = std::make_unique<FAM::rdma::RdmaMemoryBuffer>(
+    this->ids.front()->pd, FAM::max_coalesce_gap, false, false);
   this->poller = std::thread(FAM::rdma::PollCompletionQueue,
     std::ref(this->ids),
+    this->completed.get(),
     std::ref(this->keep_spinning));
+
+  if (t_io_thread) {
+    for (int i = 0; i < std::max(1, channels); ++i)
+      this->io_queues.push_back(std::make_unique<IoQueue>());
+    this->io_running = true;
+    this->io_thread = std::thread([this] { this->RunIoThread(); });
+  }
 }
 
 FAM::FamControl::RdmaServiceImpl::~RdmaServiceImpl()
 {
+  // the I/O thread waits on completions, so it stops before the poller
+  this->io_running = false;
+  if (this->io_thread.joinable()) this->io_thread.join();
   this->keep_spinning = false;
   this->poller.join();
 }
 
-namespace {
-void prep_wr(FAM::IbWorkRequest& t_wr,
-  uint64_t laddr,
-  uint64_t raddr,
-  uint32_t length,
-  uint32_t lkey,
-  uint32_t rkey,
-  ibv_wr_opcode op,
-  ibv_send_flags flags,
-  ibv_send_wr *next) noexcept
+// A thread keeps the queue it was dealt on its first Submit. When that one
+// is full it tries the others in turn, and once all of them are it yields
+// until the I/O thread has drained some.
+void FAM::FamControl::RdmaServiceImpl::Submit(
+  FAM::FamControl::Fetch const& fetch) noexcept
 {
-  ibv_send_wr& wr = t_wr.wr;
-  ibv_sge& sge = t_wr.sge;
-  memset(&wr, 0, sizeof(wr));// maybe optimize away
-
-  wr.opcode = op;
-  wr.send_flags = flags;
-  wr.wr.rdma.remote_addr = raddr;
-  wr.wr.rdma.rkey = rkey;
-  wr.next = next;
-
-  wr.sg_list = &sge;
-  wr.num_sge = 1;
-  sge.addr = laddr;
-  sge.length = length;
-  sge.lkey = lkey;
-
-  //  return std::make_pair(wr, sge);
+  static std::atomic<std::size_t> next_queue{ 0 };
+  thread_local auto const home =
+    next_queue.fetch_add(1, std::memory_order_relaxed);
+  auto const n = this->io_queues.size();
+  for (auto attempt = home;; ++attempt) {
+    if (this->io_queues[attempt % n]->TryPush(fetch)) return;
+    if ((attempt - home + 1) % n == 0) std::this_thread::yield();
+  }
 }
 
-}// namespace
+// Takes whatever the queues hold, sorts it by remote address and posts
+// fetches that continue one another as a single work request with a scatter
+// entry for each, up to what the device allows. Fetches of different workers
+// are merged this way as well. Posted batches are retired in order, since
+// they share a channel.
+void FAM::FamControl::RdmaServiceImpl::RunIoThread()
+{
+  struct InFlight
+  {
+    FAM::FamControl::Ticket ticket;
+    std::vector<std::atomic<std::uint32_t> *> pending;
+  };
+
+  auto const channel = this->ids.size() - 1;
+  std::vector<FAM::FamControl::Fetch> fetches;
+  std::vector<std::pair<std::size_t, std::size_t>> groups;
+  std::deque<InFlight> in_flight;
+  while (this->io_running.load(std::memory_order_relaxed)) {
+    FAM::FamControl::Fetch fetch;
+    for (auto const& queue : this->io_queues) {
+      while (queue->TryPop(fetch)) fetches.push_back(fetch);
+    }
+
+    if (!fetches.empty()) {
+      std::sort(fetches.begin(),
+        fetches.end(),
+        [](auto const& a, auto const& b) {
+          return std::tie(a.rkey, a.raddr) < std::tie(b.rkey, b.raddr);
+        });
+      groups.clear();
+      for (std::size_t i = 0; i < fetches.size(); ++i) {
+        if (!groups.empty()) {
+          auto& [first, last] = groups.back();
+          auto const& prev = fetches[last - 1];
+          if (fetches[i].rkey == prev.rkey
+              && fetches[i].raddr == prev.raddr + prev.length
+              && last - first < this->max_sge) {
+            ++last;
+            continue;
+          }
+        }
+        groups.emplace_back(i, i + 1);
+      }
 
+      auto const ticket = this->Post(channel,
+        groups.size(),
+        IBV_WR_RDMA_READ,
+        [&](FAM::IbWorkRequest& slot, std::size_t const g) {
+          auto const [first, last] = groups[g];
+          slot.wr.wr.rdma.remote_addr = fetches[first].raddr;
+          slot.wr.wr.rdma.rkey = fetches[first].rkey;
+          slot.wr.num_sge = static_cast<int>(last - first);
+          for (auto k = first; k < last; ++k) {
+            auto const& f = fetches[k];
+            slot.sge[k - first] = {
+              reinterpret_cast<uint64_t>(f.laddr), f.length, f.lkey
+            };
+          }
+        });
+      InFlight batch{ ticket, {} };
+      batch.pending.reserve(fetches.size());
+      for (auto const& f : fetches) batch.pending.push_back(f.pending);
+      in_flight.push_back(std::move(batch));
+      fetches.clear();
+    }
 
-void FAM::FamControl::RdmaServiceImpl::Read(uint64_t laddr,
+    while (!in_flight.empty() && this->IsComplete(in_flight.front().ticket)) {
+      for (auto *pending : in_flight.front().pending)
+        pending->fetch_sub(1, std::memory_order_release);
+      in_flight.pop_front();
+    }
+  }
+}
+
+// Chains n work requests from the channel's ring and posts them with a single
+// doorbell. fill(slot, i) sets the addresses of the i'th one. Only the last
+// of a batch and every wr_signal_interval'th request are signaled; since an
+// RC queue pair completes in order, that is enough to retire every slot.
+template<typename Fill>
+FAM::FamControl::Ticket FAM::FamControl::RdmaServiceImpl::Post(
+  unsigned long const channel,
+  std::size_t const n,
+  ibv_wr_opcode const op,
+  Fill const& fill) noexcept
+{
+  auto id = this->ids[channel].get();
+  auto *ring = this->wrs[channel].get();
+  auto& sequence_end = this->posted[channel];
+  auto const& done = this->completed[channel];
+
+  for (std::size_t i = 0; i < n;) {
+    auto const batch = std::min(n - i, FAM::wr_ring_size);
+    // wait until the slots about to be reused have been retired
+    while (sequence_end + batch - done.load(std::memory_order_acquire)
+           > FAM::wr_ring_size) {}
+
+    ibv_send_wr *first = nullptr;
+    ibv_send_wr *prev = nullptr;
+    for (std::size_t k = 0; k < batch; ++k, ++i) {
+      auto const sequence = sequence_end++;
+      auto& slot = ring[sequence % FAM::wr_ring_size];
+      auto& wr = slot.wr;
+      fill(slot, i);
+      auto const signaled =
+        k == batch - 1 || (sequence + 1) % FAM::wr_signal_interval == 0;
+      wr.opcode = op;
+      wr.wr_id = sequence;
+      wr.send_flags = signaled ? IBV_SEND_SIGNALED : 0;
+      wr.next = nullptr;
+      if (prev)
+        prev->next = &wr;
+      else
+        first = &wr;
+      prev = &wr;
+    }
+
+    struct ibv_send_wr *bad_wr = nullptr;
+    auto ret = ibv_post_send(id->qp, first, &bad_wr);
+    if (ret) spdlog::error("ibv_post_send() failed");
+  }
+
+  return FAM::FamControl::Ticket{ channel, sequence_end };
+}
+
+FAM::FamControl::Ticket FAM::FamControl::RdmaServiceImpl::Read(uint64_t laddr,
   uint64_t raddr,
   uint32_t length,
   uint32_t lkey,
   uint32_t rkey,
   unsigned long channel) noexcept
 {
-  auto id = this->ids[channel].get();
-  auto& wr = this->wrs[channel][0];
-  prep_wr(wr,
-    laddr,
-    raddr,
-    length,
-    lkey,
-    rkey,
-    IBV_WR_RDMA_READ,
-    IBV_SEND_SIGNALED,
-    nullptr);
-  struct ibv_send_wr *bad_wr = nullptr;
-
-  auto ret = ibv_post_send(id->qp, &wr.wr, &bad_wr);
-  if (ret) spdlog::error("ibv_post_send() failed (Read)");
+  return this->Post(
+    channel, 1, IBV_WR_RDMA_READ, [&](FAM::IbWorkRequest& slot, std::size_t) {
+      slot.wr.wr.rdma.remote_addr = raddr;
+      slot.wr.wr.rdma.rkey = rkey;
+      slot.wr.num_sge = 1;
+      slot.sge[0] = { laddr, length, lkey };
+    });
 }
 
-void FAM::FamControl::RdmaServiceImpl::Read(uint64_t laddr,
+FAM::FamControl::Ticket FAM::FamControl::RdmaServiceImpl::Read(uint64_t laddr,
   std::vector<FAM::FamSegment> const& segs,
   uint32_t lkey,
   uint32_t rkey,
+  FAM::CoalescePolicy policy,
   unsigned long channel) noexcept
 {
-  auto id = this->ids[channel].get();
-  for (unsigned long i = 0; i < segs.size(); ++i) {
-    auto next = i < segs.size() - 1 ? &this->wrs[channel][i + 1].wr : nullptr;
-    auto const flags = static_cast<const ibv_send_flags>(
-      i == segs.size() - 1 ? IBV_SEND_SIGNALED : 0);
-    auto& WR = this->wrs[channel][i];
-    auto const [raddr, length] = segs[i];
-    prep_wr(
-      WR, laddr, raddr, length, lkey, rkey, IBV_WR_RDMA_READ, flags, next);
-    laddr += length;
-  }
-
-  struct ibv_send_wr *bad_wr = nullptr;
-  auto& wr = this->wrs[channel][0].wr;
-
-  auto ret = ibv_post_send(id->qp, &wr, &bad_wr);
-  if (ret) spdlog::error("ibv_post_send() failed (Read)");
+  policy.max_gap = std::min(policy.max_gap, FAM::max_coalesce_gap);
+  policy.max_sge = std::clamp(policy.max_sge, 1U, this->max_sge);
+
+  // Walks segs one work request at a time: [first, last) share a request
+  // that uses sges scatter entries
+  struct Group
+  {
+    std::size_t first;
+    std::size_t last;
+    std::uint32_t sges;
+  };
+  auto const next_group = [&](std::size_t const first) {
+    Group g{ first, first + 1, 1 };
+    auto end = segs[first].raddr + segs[first].length;
+    for (; g.last < segs.size(); ++g.last) {
+      auto const [raddr, length] = segs[g.last];
+      if (raddr < end || !policy.Joins(raddr - end, g.sges)) break;
+      if (raddr != end) g.sges += 2;
+      end = raddr + length;
+    }
+    return g;
+  };
+
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < segs.size(); i = next_group(i).last) ++n;
+
+  std::size_t next = 0;
+  auto const discard_addr = reinterpret_cast<uint64_t>(this->discard->p.get());
+  auto const discard_lkey = this->discard->mr->lkey;
+  return this->Post(
+    channel, n, IBV_WR_RDMA_READ, [&](FAM::IbWorkRequest& slot, std::size_t) {
+      auto const g = next_group(next);
+      next = g.last;
+      slot.wr.wr.rdma.remote_addr = segs[g.first].raddr;
+      slot.wr.wr.rdma.rkey = rkey;
+
+      int sge = -1;
+      auto end = segs[g.first].raddr;
+      for (auto k = g.first; k < g.last; ++k) {
+        auto const [raddr, length] = segs[k];
+        if (raddr != end) {
+          auto const gap = static_cast<uint32_t>(raddr - end);
+          slot.sge[++sge] = { discard_addr, gap, discard_lkey };
+          slot.sge[++sge] = { laddr, 0, lkey };
+        } else if (sge < 0) {
+          slot.sge[++sge] = { laddr, 0, lkey };
+        }
+        slot.sge[sge].length += length;
+        laddr += length;
+        end = raddr + length;
+      }
+      slot.wr.num_sge = sge + 1;
+    });
 }
 
-void FAM::FamControl::RdmaServiceImpl::Write(uint64_t laddr,
+FAM::FamControl::Ticket FAM::FamControl::RdmaServiceImpl::Write(uint64_t laddr,
   uint64_t raddr,
   uint32_t length,
   uint32_t lkey,
   uint32_t rkey,
   unsigned long channel) noexcept
 {
-  auto id = this->ids[channel].get();
-  auto& wr = this->wrs[channel][0];
-  prep_wr(wr,
-    laddr,
-    raddr,
-    length,
-    lkey,
-    rkey,
-    IBV_WR_RDMA_WRITE,
-    IBV_SEND_SIGNALED,
-    nullptr);
-  struct ibv_send_wr *bad_wr = nullptr;
-
-  auto ret = ibv_post_send(id->qp, &wr.wr, &bad_wr);
-  if (ret) spdlog::error("ibv_post_send() failed (Write)");
+  return this->Post(
+    channel, 1, IBV_WR_RDMA_WRITE, [&](FAM::IbWorkRequest& slot, std::size_t) {
+      slot.wr.wr.rdma.remote_addr = raddr;
+      slot.wr.wr.rdma.rkey = rkey;
+      slot.wr.num_sge = 1;
+      slot.sge[0] = { laddr, length, lkey };
+    });
 }
 
-FAM::rdma::RdmaMemoryBuffer::RdmaMemoryBuffer(rdma_cm_id *id,
+FAM::rdma::RdmaMemoryBuffer::RdmaMemoryBuffer(ibv_pd *pd,
   std::uint64_t const t_size,
   bool const use_HP,
   bool const write_allowed)
@@ -252,7 +433,21 @@ FAM::rdma::RdmaMemoryBuffer::RdmaMemoryBuffer(rdma_cm_id *id,
   auto ptr = p.get();
   auto constexpr flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ;
   auto const write = write_allowed ? IBV_ACCESS_REMOTE_WRITE : 0;
-  this->mr = ibv_reg_mr(id->pd, ptr, t_size, flags | write);
+  this->mr = ibv_reg_mr(pd, ptr, t_size, flags | write);
+
+  if (!this->mr) throw std::runtime_error("rdma_reg() failed!");
+}
+
+FAM::rdma::RdmaMemoryBuffer::RdmaMemoryBuffer(ibv_pd *pd,
+  void *addr,
+  std::uint64_t const t_size,
+  bool const write_allowed)
+  : size{ t_size }, p{ addr, [](void *) noexcept {} }
+{
+  spdlog::debug("RdmaMemoryBuffer() (external)");
+  auto constexpr flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ;
+  auto const write = write_allowed ? IBV_ACCESS_REMOTE_WRITE : 0;
+  this->mr = ibv_reg_mr(pd, addr, t_size, flags | write);
 
   if (!this->mr) throw std::runtime_error("rdma_reg() failed!");
 }
@@ -265,6 +460,7 @@ FAM::rdma::RdmaMemoryBuffer::~RdmaMemoryBuffer()
 
 void FAM::rdma::PollCompletionQueue(
   std::vector<std::unique_ptr<rdma_cm_id, FAM::rdma::RdmaIdDeleter>>& cm_ids,
+  std::atomic<std::uint64_t> *completed,
   std::atomic<bool>& keep_spinning)
 {
   constexpr auto k = 10;
@@ -274,8 +470,8 @@ void FAM::rdma::PollCompletionQueue(
 
   while (keep_spinning) {
     for (unsigned long iter = 0; iter < batch; ++iter) {
-      for (auto& id : cm_ids) {
-        cq = id->send_cq;
+      for (std::size_t channel = 0; channel < cm_ids.size(); ++channel) {
+        cq = cm_ids[channel]->send_cq;
         if (int n = ibv_poll_cq(cq, k, wc)) {
           for (int i = 0; i < n; ++i) {
             if (wc[i].status != IBV_WC_SUCCESS) {
@@ -284,6 +480,9 @@ void FAM::rdma::PollCompletionQueue(
               throw std::runtime_error("ibv_poll_cq() failed");
             }
           }
+          // completions of a queue pair arrive in posting order
+          completed[channel].store(
+            wc[n - 1].wr_id + 1, std::memory_order_release);
         }
       }
     }
@@ -1,6 +1,7 @@
 #ifndef _FAM_RDMA_H_
 #define _FAM_RDMA_H_
 
+#include <algorithm>
 #include <vector>
 #include <memory>
 #include <rdma/rdma_cma.h>
@@ -10,10 +11,12 @@
 #include <cstring>
 #include <thread>
 #include <atomic>
+#include <cstdint>
 
 #include <FAM_segment.hpp>
 #include "util.hpp"
 #include "FAM.hpp"
+#include <FAM_constants.hpp>
 
 namespace FAM {
 namespace rdma {
@@ -46,6 +49,28 @@ namespace rdma {
       decltype(del)>(channel, del);
   }
 
+  struct ProtectionDomainDeleter
+  {
+    void operator()(ibv_pd *pd) noexcept { ibv_dealloc_pd(pd); }
+  };
+
+  // Allocates a protection domain on the first RDMA device, for memory that
+  // must be registered before (and outlive) any single connection.
+  auto inline CreateProtectionDomain()
+  {
+    int num_devices = 0;
+    auto devices = rdma_get_devices(&num_devices);
+    if (!devices || num_devices == 0) {
+      if (devices) rdma_free_devices(devices);
+      throw std::runtime_error("rdma_get_devices() found no devices");
+    }
+    auto pd = ibv_alloc_pd(devices[0]);
+    rdma_free_devices(devices);
+    if (!pd) throw std::runtime_error("ibv_alloc_pd() failed");
+    ProtectionDomainDeleter del;
+    return std::unique_ptr<ibv_pd, decltype(del)>(pd, del);
+  }
+
   auto inline CreateRdmaId(rdma_event_channel *const channel)
   {
     rdma_cm_id *id;
@@ -76,12 +101,22 @@ namespace rdma {
 
   int inline HCA_responder_resources() { return 0; }
 
-  auto inline RdmaConnParams() noexcept
+  // Lets as many rdma reads be outstanding on a connection as the device of
+  // verbs allows, both those it issues and those it serves. A connection
+  // runs at the smaller of what its two ends offer.
+  auto inline RdmaConnParams(ibv_context *const verbs)
   {
+    struct ibv_device_attr device_attr;
+    if (ibv_query_device(verbs, &device_attr))
+      throw std::runtime_error("ibv_query_device() failed!");
+    auto const depth = [](int const atoms) {
+      return static_cast<std::uint8_t>(std::clamp(atoms, 1, 255));
+    };
+
     struct rdma_conn_param params;
     std::memset(&params, 0, sizeof(params));
-    params.responder_resources = 1;
-    params.initiator_depth = 1;
+    params.responder_resources = depth(device_attr.max_qp_rd_atom);
+    params.initiator_depth = depth(device_attr.max_qp_init_rd_atom);
     params.rnr_retry_count = 7;
 
     return params;
@@ -94,19 +129,87 @@ namespace rdma {
     std::unique_ptr<void, std::function<void(void *)>> p;
     ibv_mr *mr;
 
-    RdmaMemoryBuffer(rdma_cm_id *id,
+    RdmaMemoryBuffer(ibv_pd *pd,
       std::uint64_t const t_size,
       bool const use_HP,
       bool const write_allowed);
 
+    // Registers memory owned by the caller; it is not unmapped on destruction
+    RdmaMemoryBuffer(ibv_pd *pd,
+      void *addr,
+      std::uint64_t const t_size,
+      bool const write_allowed);
+
     RdmaMemoryBuffer(RdmaMemoryBuffer &&) = delete;
     RdmaMemoryBuffer &operator=(RdmaMemoryBuffer &&) = delete;
 
     ~RdmaMemoryBuffer();
   };
 
+  // Bounded queue for many producers and one consumer (after D. Vyukov). The
+  // sequence number of a cell tells whose turn it is: producers claim
+  // positions with a CAS, the consumer owns the read position.
+  template<typename T, std::size_t Size> class SubmissionQueue
+  {
+    static_assert((Size & (Size - 1)) == 0);
+
+    struct Cell
+    {
+      std::atomic<std::size_t> sequence;
+      T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<std::size_t> push_position_{ 0 };
+    alignas(64) std::size_t pop_position_{ 0 };
+
+  public:
+    SubmissionQueue() : cells_{ new Cell[Size] }
+    {
+      for (std::size_t i = 0; i < Size; ++i)
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool TryPush(T const &value) noexcept
+    {
+      auto position = this->push_position_.load(std::memory_order_relaxed);
+      while (true) {
+        auto &cell = this->cells_[position & (Size - 1)];
+        auto const sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+          if (this->push_position_.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+            cell.value = value;
+            cell.sequence.store(position + 1, std::memory_order_release);
+            return true;
+          }
+        } else if (sequence < position) {
+          return false;// full
+        } else {
+          position = this->push_position_.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    // Only called by the consumer
+    bool TryPop(T &value) noexcept
+    {
+      auto const position = this->pop_position_;
+      auto &cell = this->cells_[position & (Size - 1)];
+      if (cell.sequence.load(std::memory_order_acquire) != position + 1)
+        return false;
+      value = cell.value;
+      cell.sequence.store(position + Size, std::memory_order_release);
+      ++this->pop_position_;
+      return true;
+    }
+  };
+
+  // completed[i] tracks how many work requests of channel i (cm_ids[i]) are
+  // done; signaled work requests carry their sequence number in wr_id.
   void PollCompletionQueue(
     std::vector<std::unique_ptr<rdma_cm_id, FAM::rdma::RdmaIdDeleter>> &cm_ids,
+    std::atomic<std::uint64_t> *completed,
     std::atomic<bool> &keep_spinning);
 
 
@@ -124,14 +227,41 @@ class FAM::FamControl::RdmaServiceImpl
   std::vector<decltype(FAM::rdma::CreateRdmaId(ec.get()))> ids;
   std::thread poller;
   std::atomic<bool> keep_spinning = true;
+  // Per channel ring of FAM::wr_ring_size preinitialized work requests.
+  // posted is only touched by the thread using the channel, completed only
+  // advanced by the poller.
   std::vector<std::unique_ptr<IbWorkRequest[]>> wrs;
+  std::vector<std::uint64_t> posted;
+  std::unique_ptr<std::atomic<std::uint64_t>[]> completed;
+  std::uint64_t const session_id;
+  // scatter entries per work request the device takes for rdma reads, and
+  // where the gaps of coalesced reads go
+  std::uint32_t max_sge = FAM::max_scatter_entries;
+  std::unique_ptr<FAM::rdma::RdmaMemoryBuffer> discard;
+  // Fetches submitted for the I/O thread, which posts them on the last
+  // channel. Each submitting thread is dealt a queue of its own, round robin
+  // (see Submit).
+  using IoQueue =
+    FAM::rdma::SubmissionQueue<FAM::FamControl::Fetch, FAM::io_queue_size>;
+  std::vector<std::unique_ptr<IoQueue>> io_queues;
+  std::thread io_thread;
+  std::atomic<bool> io_running = false;
 
   void CreateConnection();
+  void RunIoThread();
+
+  template<typename Fill>
+  FAM::FamControl::Ticket Post(unsigned long channel,
+    std::size_t n,
+    ibv_wr_opcode op,
+    Fill const &fill) noexcept;
 
 public:
   RdmaServiceImpl(std::string const &t_host,
     std::string const &t_port,
-    int const channels);
+    int const channels,
+    std::uint64_t const t_session_id,
+    bool const t_io_thread);
 
   ~RdmaServiceImpl();
 
@@ -142,25 +272,43 @@ public:
     bool const use_HP,
     bool const write_allowed);
 
-  void Read(uint64_t laddr,
+  uint32_t RegisterRegion(void *addr,
+    std::uint64_t const t_size,
+    bool const write_allowed);
+
+  FAM::FamControl::Ticket Read(uint64_t laddr,
     uint64_t raddr,
     uint32_t length,
     uint32_t lkey,
     uint32_t rkey,
     unsigned long channel) noexcept;
 
-  void Read(uint64_t laddr,
+  FAM::FamControl::Ticket Read(uint64_t laddr,
     std::vector<FamSegment> const &segs,
     uint32_t lkey,
     uint32_t rkey,
+    CoalescePolicy policy,
     unsigned long channel) noexcept;
 
-  void Write(uint64_t laddr,
+  CoalescePolicy MaxCoalescePolicy() const noexcept
+  {
+    return CoalescePolicy{ FAM::max_coalesce_gap, this->max_sge };
+  }
+
+  FAM::FamControl::Ticket Write(uint64_t laddr,
     uint64_t raddr,
     uint32_t length,
     uint32_t lkey,
     uint32_t rkey,
     unsigned long channel) noexcept;
+
+  bool IsComplete(FAM::FamControl::Ticket ticket) const noexcept
+  {
+    auto const &done = this->completed[ticket.channel];
+    return done.load(std::memory_order_acquire) >= ticket.sequence;
+  }
+
+  void Submit(FAM::FamControl::Fetch const &fetch) noexcept;
 };
 
 #endif
@@ -1,9 +1,11 @@
 #include <FAM.hpp>
 
+#include <chrono>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <memory>
-#include <cassert>
+#include <tuple>
 
 #include <grpcpp/grpcpp.h>
 
@@ -22,9 +24,11 @@ class FAM::FamControl::ControlServiceImpl
 {
 public:
   ControlServiceImpl(std::shared_ptr<Channel> channel)
-    : stub_(FAMController::NewStub(channel))
+    : stub_(FAMController::NewStub(channel)), session_id_(BeginSession())
   {}
 
+  std::uint64_t SessionId() const noexcept { return session_id_; }
+
   void Ping()
   {
     fam::PingRequest request;
@@ -40,6 +44,7 @@ public:
   {
     fam::AllocateRegionRequest request;
     request.set_size(size);
+    request.set_session_id(session_id_);
     fam::AllocateRegionReply reply;
     ClientContext context;
     auto const status = stub_->AllocateRegion(&context, request, &reply);
@@ -50,23 +55,69 @@ public:
     throw std::runtime_error(status.error_message());
   }
 
-  auto MmapFile(std::string const &filepath)
+  auto MmapFile(std::string const &filepath,
+    std::uint64_t const offset,
+    std::uint64_t const length,
+    bool const progressive)
   {
     fam::MmapFileRequest request;
     request.set_path(filepath);
+    request.set_offset(offset);
+    request.set_length(length);
+    request.set_session_id(session_id_);
+    request.set_progressive(progressive);
     fam::MmapFileReply reply;
     ClientContext context;
     auto const status = stub_->MmapFile(&context, request, &reply);
 
+    if (status.ok()) return reply;
+
+    throw std::runtime_error(status.error_message());
+  }
+
+  auto FileSize(std::string const &filepath)
+  {
+    fam::FileSizeRequest request;
+    request.set_path(filepath);
+    fam::FileSizeReply reply;
+    ClientContext context;
+    auto const status = stub_->FileSize(&context, request, &reply);
+
+    if (status.ok()) return reply.length();
+
+    throw std::runtime_error(status.error_message());
+  }
+
+  // Empty if the server refused or did not answer within gather_deadline_
+  std::optional<std::tuple<std::uint64_t, std::uint64_t, std::uint32_t>>
+    Gather(std::uint64_t const region,
+      std::vector<FAM::FamSegment> const &segs,
+      std::uint32_t const slot)
+  {
+    fam::GatherRequest request;
+    request.set_session_id(session_id_);
+    request.set_region(region);
+    request.set_slot(slot);
+    for (auto const &seg : segs) {
+      request.add_addrs(seg.raddr);
+      request.add_lengths(seg.length);
+    }
+    fam::GatherReply reply;
+    ClientContext context;
+    context.set_deadline(std::chrono::system_clock::now() + gather_deadline_);
+    auto const status = stub_->Gather(&context, request, &reply);
+
     if (status.ok())
       return std::make_tuple(reply.addr(), reply.length(), reply.rkey());
 
-    throw std::runtime_error(status.error_message());
+    spdlog::warn("Gather failed: {}", status.error_message());
+    return std::nullopt;
   }
 
   void EndSession()
   {
     fam::EndSessionRequest request;
+    request.set_session_id(session_id_);
     fam::EndSessionReply reply;
     ClientContext context;
 
@@ -76,19 +127,36 @@ public:
   }
 
 private:
+  static constexpr auto gather_deadline_ = std::chrono::seconds{ 1 };
+
   std::unique_ptr<FAMController::Stub> stub_;
+  std::uint64_t const session_id_;
+
+  std::uint64_t BeginSession()
+  {
+    fam::BeginSessionRequest request;
+    fam::BeginSessionReply reply;
+    ClientContext context;
+
+    Status status = stub_->BeginSession(&context, request, &reply);
+    if (status.ok()) return reply.session_id();
+    throw std::runtime_error(status.error_message());
+  }
 };
 
 FAM::FamControl::FamControl(std::string const &control_addr,
   std::string const &ipoib_addr,
   std::string const &ipoib_port,
-  int const rdma_channels)
+  int const rdma_channels,
+  bool const io_thread)
   : control_service_{ std::make_unique<
     FamControl::FamControl::ControlServiceImpl>(
     grpc::CreateChannel(control_addr, grpc::InsecureChannelCredentials())) },
     rdma_service_{ std::make_unique<FamControl::RdmaServiceImpl>(ipoib_addr,
       ipoib_port,
-      rdma_channels) },
+      rdma_channels,
+      control_service_->SessionId(),
+      io_thread) },
     rdma_channels_{ rdma_channels }
 {}
 
@@ -111,13 +179,52 @@ FAM::FamControl::RemoteRegion FAM::FamControl::AllocateRegion(
   return FamControl::RemoteRegion{ addr, length, rkey };
 }
 
+std::uint64_t FAM::FamControl::FileSize(std::string const &filepath)
+{
+  return this->control_service_->FileSize(filepath);
+}
+
 FAM::FamControl::RemoteRegion FAM::FamControl::MmapRemoteFile(
-  std::string const &filepath)
+  std::string const &filepath,
+  std::uint64_t const offset,
+  std::uint64_t const length)
 {
-  auto const [addr, length, rkey] = this->control_service_->MmapFile(filepath);
-  return FamControl::RemoteRegion{ addr, length, rkey };
+  auto const reply =
+    this->control_service_->MmapFile(filepath, offset, length, false);
+  return FamControl::RemoteRegion{ reply.addr(), reply.length(), reply.rkey() };
+}
+
+FAM::FamControl::RemoteFile FAM::FamControl::MmapRemoteFileAsync(
+  std::string const &filepath,
+  std::uint64_t const offset,
+  std::uint64_t const length)
+{
+  auto const reply =
+    this->control_service_->MmapFile(filepath, offset, length, true);
+  auto const chunks =
+    (reply.length() + reply.chunk_size() - 1) / reply.chunk_size();
+  return FamControl::RemoteFile{
+    FamControl::RemoteRegion{ reply.addr(), reply.length(), reply.rkey() },
+    FamControl::RemoteRegion{ reply.ready_addr(), chunks, reply.ready_rkey() },
+    reply.chunk_size()
+  };
 }
 
+std::optional<FAM::FamControl::RemoteRegion> FAM::FamControl::Gather(
+  RemoteRegion const &file,
+  std::vector<FamSegment> const &segs,
+  std::uint32_t const slot) noexcept
+{
+  try {
+    auto const staged = this->control_service_->Gather(file.raddr, segs, slot);
+    if (!staged) return std::nullopt;
+    auto const [addr, length, rkey] = *staged;
+    return FamControl::RemoteRegion{ addr, length, rkey };
+  } catch (std::exception const &e) {
+    spdlog::warn("Gather failed: {}", e.what());
+    return std::nullopt;
+  }
+}
 
 FAM::FamControl::LocalRegion FAM::FamControl::CreateRegion(
   const std::uint64_t t_size,
@@ -130,37 +237,75 @@ FAM::FamControl::LocalRegion FAM::FamControl::CreateRegion(
   return FamControl::LocalRegion{ addr, length, lkey };
 }
 
-void FAM::FamControl::Read(void *laddr,
+FAM::FamControl::LocalRegion FAM::FamControl::RegisterRegion(void *laddr,
+  const std::uint64_t t_size,
+  const bool write_allowed)
+{
+  auto const lkey =
+    this->rdma_service_->RegisterRegion(laddr, t_size, write_allowed);
+  return FamControl::LocalRegion{ laddr, t_size, lkey };
+}
+
+FAM::FamControl::Ticket FAM::FamControl::Read(void *laddr,
   uint64_t raddr,
   uint32_t length,
   uint32_t lkey,
   uint32_t rkey,
   unsigned long channel = 0) noexcept
 {
-  this->rdma_service_->Read(
+  return this->rdma_service_->Read(
     reinterpret_cast<uint64_t>(laddr), raddr, length, lkey, rkey, channel);
 }
 
-void FAM::FamControl::Read(void *laddr,
+FAM::FamControl::Ticket FAM::FamControl::Read(void *laddr,
+  std::vector<FAM::FamSegment> const &segs,
+  uint32_t lkey,
+  uint32_t rkey,
+  unsigned long channel) noexcept
+{
+  return this->rdma_service_->Read(
+    reinterpret_cast<uint64_t>(laddr), segs, lkey, rkey, {}, channel);
+}
+
+FAM::FamControl::Ticket FAM::FamControl::Read(void *laddr,
   std::vector<FAM::FamSegment> const &segs,
   uint32_t lkey,
   uint32_t rkey,
+  CoalescePolicy const policy,
   unsigned long channel) noexcept
 {
-  // uphold the narrow calling contract
-  assert(segs.size() <= FAM::max_outstanding_wr);
-  this->rdma_service_->Read(
-    reinterpret_cast<uint64_t>(laddr), segs, lkey, rkey, channel);
+  return this->rdma_service_->Read(
+    reinterpret_cast<uint64_t>(laddr), segs, lkey, rkey, policy, channel);
+}
+
+FAM::CoalescePolicy FAM::FamControl::MaxCoalescePolicy() const noexcept
+{
+  return this->rdma_service_->MaxCoalescePolicy();
 }
 
 
-void FAM::FamControl::Write(void *laddr,
+FAM::FamControl::Ticket FAM::FamControl::Write(void *laddr,
   uint64_t raddr,
   uint32_t length,
   uint32_t lkey,
   uint32_t rkey,
   unsigned long channel = 0) noexcept
 {
-  this->rdma_service_->Write(
+  return this->rdma_service_->Write(
     reinterpret_cast<uint64_t>(laddr), raddr, length, lkey, rkey, channel);
 }
+
+bool FAM::FamControl::IsComplete(Ticket const ticket) const noexcept
+{
+  return this->rdma_service_->IsComplete(ticket);
+}
+
+void FAM::FamControl::Wait(Ticket const ticket) const noexcept
+{
+  while (!this->IsComplete(ticket)) {}
+}
+
+void FAM::FamControl::Submit(Fetch const &fetch) noexcept
+{
+  this->rdma_service_->Submit(fetch);
+}
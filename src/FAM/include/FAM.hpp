@@ -4,14 +4,21 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <cstdint>
+#include <atomic>
+#include <optional>
 
 #include <FAM_segment.hpp>
 
 namespace FAM {
 namespace server {
+  // preload_files are mapped at startup and stay resident; retain_files
+  // keeps every mapped file resident after its last session ends
   void RunServer(std::string const &host,
     std::string const &port,
-    const uint64_t memserver_port);
+    const uint64_t memserver_port,
+    std::vector<std::string> const &preload_files = {},
+    bool const retain_files = false);
 }// namespace server
 class FamControl
 {
@@ -30,6 +37,21 @@ public:
     uint32_t rkey;
   };
 
+  // A file the server is still copying in. Byte i of ready covers bytes
+  // [i * chunk_size, (i + 1) * chunk_size) of data and turns chunk_ready once
+  // they are loaded, so a client can rdma read the map and start on the
+  // loaded prefix.
+  struct RemoteFile
+  {
+    static constexpr std::uint8_t chunk_loading = 0;
+    static constexpr std::uint8_t chunk_ready = 1;
+    static constexpr std::uint8_t chunk_failed = 2;
+
+    RemoteRegion data;
+    RemoteRegion ready;
+    uint64_t chunk_size;
+  };
+
   struct LocalRegion
   {
     void *laddr;
@@ -37,42 +59,102 @@ public:
     uint32_t lkey;
   };
 
+  // io_thread adds a channel for the I/O thread that serves Submit
   FamControl(std::string const &control_addr,
     std::string const &ipoib_addr,
     std::string const &ipoib_port,
-    int const rdma_channels);
+    int const rdma_channels,
+    bool const io_thread = false);
   ~FamControl();
 
   // Control services
   void Ping();
   RemoteRegion AllocateRegion(uint64_t size);
-  RemoteRegion MmapRemoteFile(std::string const &filepath);
+  uint64_t FileSize(std::string const &filepath);
+  RemoteRegion MmapRemoteFile(std::string const &filepath,
+    uint64_t offset = 0,
+    uint64_t length = 0);
+  // Returns as soon as the region is registered; see RemoteFile
+  RemoteFile MmapRemoteFileAsync(std::string const &filepath,
+    uint64_t offset = 0,
+    uint64_t length = 0);
+  // Has the server pack segs of a mapped file contiguously into the staging
+  // region for slot, which is returned. The region is reused by the next
+  // Gather on the same slot. Empty if the server refused or did not answer
+  // in time; segs can then be read directly.
+  std::optional<RemoteRegion> Gather(RemoteRegion const &file,
+    std::vector<FamSegment> const &segs,
+    uint32_t slot) noexcept;
 
   // rdma services
   LocalRegion CreateRegion(uint64_t const t_size,
     bool const use_hugepages,
     bool const write_allowed);
+  LocalRegion RegisterRegion(void *laddr,
+    uint64_t const t_size,
+    bool const write_allowed);
 
   // rdma Dataplane
-  void Read(void *laddr,
+
+  // Identifies a posted batch of work requests. A ticket is complete once
+  // the batch, and every batch posted before it on the same channel, is done.
+  struct Ticket
+  {
+    unsigned long channel;
+    uint64_t sequence;
+  };
+
+  Ticket Read(void *laddr,
     uint64_t raddr,
     uint32_t length,
     uint32_t lkey,
     uint32_t rkey,
     unsigned long channel) noexcept;
 
-  void Read(void *laddr,
+  Ticket Read(void *laddr,
     std::vector<FamSegment> const &segs,
     uint32_t lkey,
     uint32_t rkey,
     unsigned long channel) noexcept;
 
-  void Write(void *laddr,
+  // segs still land back to back at laddr; policy decides which of them
+  // share a work request (see CoalescePolicy), clamped to MaxCoalescePolicy
+  Ticket Read(void *laddr,
+    std::vector<FamSegment> const &segs,
+    uint32_t lkey,
+    uint32_t rkey,
+    CoalescePolicy policy,
+    unsigned long channel) noexcept;
+
+  CoalescePolicy MaxCoalescePolicy() const noexcept;
+
+  Ticket Write(void *laddr,
     uint64_t raddr,
     uint32_t length,
     uint32_t lkey,
     uint32_t rkey,
     unsigned long channel) noexcept;
+
+  bool IsComplete(Ticket ticket) const noexcept;
+  void Wait(Ticket ticket) const noexcept;
+
+  // A read for the I/O thread. pending is decremented once the bytes are at
+  // laddr, so several fetches can share one counter.
+  struct Fetch
+  {
+    void *laddr;
+    uint64_t raddr;
+    uint32_t length;
+    uint32_t lkey;
+    uint32_t rkey;
+    std::atomic<uint32_t> *pending;
+  };
+
+  // Queues fetch for the I/O thread instead of posting it on a channel. The
+  // thread takes the fetches of all submitters, sorts them by remote address
+  // and reads adjacent ones with a single work request, scattering the bytes
+  // to their buffers. Needs a FamControl created with io_thread.
+  void Submit(Fetch const &fetch) noexcept;
 };
 }// namespace FAM
 
@@ -1,6 +1,8 @@
 #ifndef __FAM_SEGMENT_H__
 #define __FAM_SEGMENT_H__
 
+#include <cstdint>
+
 namespace FAM {
 
 struct FamSegment
@@ -9,6 +11,23 @@ struct FamSegment
   uint32_t length;
 };
 
+// When segments of a vector read share a work request. Adjacent segments
+// always do; one starting up to max_gap bytes after the previous one joins
+// its work request too, with the bytes in between scattered to a discard
+// buffer, as long as the request has scatter entries left for both.
+struct CoalescePolicy
+{
+  uint32_t max_gap = 0;
+  uint32_t max_sge = 1;
+
+  // gap: bytes between the previous segment and this one, sges: scatter
+  // entries the current work request already uses
+  bool Joins(uint64_t gap, uint32_t sges) const noexcept
+  {
+    return gap == 0 || (gap <= max_gap && sges + 2 <= max_sge);
+  }
+};
+
 }// namespace FAM
 
 
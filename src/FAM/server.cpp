@@ -2,15 +2,24 @@
 #include "FAM_rdma.hpp"
 #include "util.hpp"
 
+#include <cerrno>
 #include <cstdlib>
 #include <functional>
 #include <string>
 #include <thread>
 #include <cstring>
-#include <poll.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 
 #include <memory>
 #include <chrono>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include <sys/random.h>
 
 #include <grpc/support/log.h>
 #include <grpcpp/grpcpp.h>
@@ -21,19 +30,571 @@
 
 namespace {
 
+// A file registered for rdma and copied in by background loaders, chunk by
+// chunk, so clients can be handed the region before the copy finishes. ready
+// holds one byte per chunk (see FamControl::RemoteFile) and is itself
+// registered so clients can poll it with rdma reads. The loaders are joined
+// on destruction; a file evicted early stops loading after its current chunk.
+class loaded_file
+{
+  std::string const path_;
+  std::uint64_t const offset_;
+  std::atomic<std::uint64_t> next_chunk_{ 0 };
+  std::atomic<bool> stop_{ false };
+  std::vector<std::thread> loaders_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+  std::uint64_t remaining_;
+  bool failed_{ false };
+
+  using remote_file = FAM::FamControl::RemoteFile;
+  static constexpr std::uint64_t chunk_size_ = 1UL << 26;// 64 MB
+
+  void LoadChunks()
+  {
+    auto const array = static_cast<char *>(this->buffer->p.get());
+    auto const flags = static_cast<std::uint8_t *>(this->ready->p.get());
+    for (auto i = next_chunk_++; i < this->chunks && !stop_;
+         i = next_chunk_++) {
+      auto const begin = i * chunk_size_;
+      auto const length = std::min(chunk_size_, this->buffer->size - begin);
+      auto state = remote_file::chunk_ready;
+      try {
+        FAM::Util::copy_file(array + begin, path_, offset_ + begin, length);
+      } catch (std::exception const &e) {
+        spdlog::error("Loading {} chunk {} failed: {}", path_, i, e.what());
+        state = remote_file::chunk_failed;
+      }
+      std::atomic_thread_fence(std::memory_order_release);
+      flags[i] = state;
+
+      std::lock_guard<std::mutex> lock{ mutex_ };
+      failed_ = failed_ || state == remote_file::chunk_failed;
+      if (--remaining_ == 0) {
+        spdlog::info("Loaded {} [{}, +{})", path_, offset_, this->buffer->size);
+        done_.notify_all();
+      }
+    }
+  }
+
+public:
+  std::unique_ptr<FAM::rdma::RdmaMemoryBuffer> const buffer;
+  std::unique_ptr<FAM::rdma::RdmaMemoryBuffer> const ready;
+  std::uint64_t const chunks;
+
+  loaded_file(ibv_pd *pd,
+    std::string path,
+    std::uint64_t const offset,
+    std::uint64_t const length)
+    : path_{ std::move(path) }, offset_{ offset },
+      remaining_{ (length + chunk_size_ - 1) / chunk_size_ },
+      buffer{ std::make_unique<FAM::rdma::RdmaMemoryBuffer>(pd,
+        length,
+        false,
+        false) },
+      ready{ std::make_unique<FAM::rdma::RdmaMemoryBuffer>(pd,
+        std::max<std::uint64_t>(remaining_, 1),
+        false,
+        false) },
+      chunks{ remaining_ }
+  {}
+
+  ~loaded_file()
+  {
+    stop_ = true;
+    for (auto &loader : loaders_) loader.join();
+  }
+
+  loaded_file &operator=(const loaded_file &) = delete;
+  loaded_file(const loaded_file &) = delete;
+
+  static constexpr std::uint64_t ChunkSize() noexcept { return chunk_size_; }
+
+  void Start()
+  {
+    auto const n_loaders = std::min<std::uint64_t>(
+      this->chunks, std::max(1u, std::thread::hardware_concurrency()));
+    loaders_.reserve(n_loaders);
+    for (auto i = 0u; i < n_loaders; ++i)
+      loaders_.emplace_back([this] { this->LoadChunks(); });
+  }
+
+  // True once any chunk has failed to load
+  bool Failed()
+  {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    return failed_;
+  }
+
+  void Wait()
+  {
+    std::unique_lock<std::mutex> lock{ mutex_ };
+    done_.wait(lock, [this] { return remaining_ == 0; });
+    if (failed_) throw std::runtime_error("mmap RPC: loading file failed");
+  }
+};
+
+// Files mapped for clients, keyed by the file version and byte range so that
+// every session asking for the same graph shares one registered region. A
+// file that failed to load is never handed out again: the next request for it
+// loads it afresh, and it is evicted once unused even if pinned.
+class file_registry
+{
+  struct file_key
+  {
+    std::string path;
+    std::uint64_t offset;
+    std::uint64_t length;
+    std::time_t mtime;
+
+    bool operator<(file_key const &rhs) const
+    {
+      return std::tie(path, offset, length, mtime)
+             < std::tie(rhs.path, rhs.offset, rhs.length, rhs.mtime);
+    }
+  };
+
+  struct registered_file
+  {
+    std::shared_ptr<loaded_file> file;
+    std::uint32_t refs;
+    bool pinned;
+    bool registering;
+  };
+
+  ibv_pd *const pd_;
+  bool const retain_;
+  std::map<file_key, registered_file> files_;
+  std::mutex mutex_;
+  std::condition_variable registered_;
+
+  void Evict(std::map<file_key, registered_file>::iterator it)
+  {
+    spdlog::info("Unloading {} [{}, +{})",
+      it->first.path,
+      it->first.offset,
+      it->first.length);
+    files_.erase(it);
+  }
+
+  // A newer version of a file supersedes stale ones; drop those nobody uses
+  void EvictStale(file_key const &current)
+  {
+    for (auto it = files_.begin(); it != files_.end();) {
+      auto const &key = it->first;
+      auto const stale = key.path == current.path
+                         && key.offset == current.offset
+                         && key.length == current.length
+                         && key.mtime != current.mtime;
+      if (stale) it->second.pinned = false;
+      if (stale && it->second.refs == 0)
+        this->Evict(it++);
+      else
+        ++it;
+    }
+  }
+
+  void Unref(std::map<file_key, registered_file>::iterator it)
+  {
+    auto &file = it->second;
+    if (--file.refs == 0 && (!file.pinned || !file.file || file.file->Failed()))
+      this->Evict(it);
+  }
+
+public:
+  using handle = file_key;
+
+  file_registry(ibv_pd *pd, bool retain) : pd_{ pd }, retain_{ retain } {}
+
+  file_registry &operator=(const file_registry &) = delete;
+  file_registry(const file_registry &) = delete;
+
+  // Registration runs without the lock held; concurrent requests for a file
+  // that is still being registered wait for the first one. The copy itself is
+  // left to the file's loaders, use loaded_file::Wait to block on it.
+  std::pair<handle, std::shared_ptr<loaded_file>> Acquire(
+    std::string const &path,
+    std::uint64_t const offset,
+    std::uint64_t const length,
+    bool const pin = false)
+  {
+    auto const filesize = FAM::Util::file_size(path);
+    if (offset > filesize)
+      throw std::runtime_error("mmap RPC: offset is past end of file");
+    auto const mapped_length = length == 0 ? filesize - offset : length;
+    if (mapped_length > filesize - offset)
+      throw std::runtime_error("mmap RPC: range is past end of file");
+
+    file_key key{ path, offset, mapped_length, FAM::Util::file_mtime(path) };
+    std::unique_lock<std::mutex> lock{ mutex_ };
+    auto [it, inserted] =
+      files_.try_emplace(key, registered_file{ nullptr, 0, false, true });
+    auto &entry = it->second;
+    entry.pinned = entry.pinned || pin || retain_;
+    ++entry.refs;
+
+    if (!inserted) {
+      registered_.wait(lock, [&entry] { return !entry.registering; });
+      if (entry.file && !entry.file->Failed()) return { key, entry.file };
+      // sessions still holding the failed file keep it alive until they end
+      entry.registering = true;
+    }
+
+    lock.unlock();
+    std::shared_ptr<loaded_file> file;
+    try {
+      spdlog::info("Loading {} [{}, +{})", path, offset, mapped_length);
+      file = std::make_shared<loaded_file>(pd_, path, offset, mapped_length);
+      file->Start();
+    } catch (...) {
+      lock.lock();
+      entry.registering = false;
+      this->Unref(it);
+      registered_.notify_all();
+      throw;
+    }
+    lock.lock();
+    entry.file = std::move(file);
+    entry.registering = false;
+    this->EvictStale(key);
+    registered_.notify_all();
+
+    return { key, entry.file };
+  }
+
+  void Release(handle const &key)
+  {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    auto it = files_.find(key);
+    if (it != files_.end()) this->Unref(it);
+  }
+
+  void Preload(std::string const &path)
+  {
+    auto const [key, file] = this->Acquire(path, 0, 0, true);
+    this->Release(key);
+  }
+};
+
+struct region_info
+{
+  std::uint64_t addr;
+  std::uint64_t length;
+  std::uint32_t rkey;
+};
+
+struct file_info
+{
+  region_info data;
+  region_info ready;
+  std::uint64_t chunk_size;
+};
+
 class session
 {
 public:
-  rdma_cm_id *const id;
+  file_registry &files;
   std::vector<std::unique_ptr<FAM::rdma::RdmaMemoryBuffer>> client_regions;
+  std::vector<file_registry::handle> client_files;
+  // mapped files by region address, and Gather staging regions by slot
+  std::map<std::uint64_t, std::shared_ptr<loaded_file>> mapped_files;
+  std::map<std::uint32_t, std::shared_ptr<FAM::rdma::RdmaMemoryBuffer>>
+    staging;
+  std::size_t connections{ 0 };
+  // set by the first rdma connection; sessions that never get one expire
+  bool connected{ false };
+  std::chrono::steady_clock::time_point const begun{
+    std::chrono::steady_clock::now()
+  };
+
+  explicit session(file_registry &t_files) : files{ t_files } {}
 
-  session(rdma_cm_id *t_id) : id{ t_id } {}
+  ~session() { this->Clear(); }
 
   session &operator=(const session &) = delete;
   session(const session &) = delete;
+
+  void Clear()
+  {
+    for (auto const &file : this->client_files) this->files.Release(file);
+    this->client_files.clear();
+    this->client_regions.clear();
+    this->mapped_files.clear();
+    this->staging.clear();
+  }
+};
+
+// One session per client. A session ends on EndSession, when the last of its
+// rdma connections goes away without one (e.g. the client crashed), or when
+// it never connects at all within connect_timeout_. Session ids are random so
+// that one client cannot guess, and end or read from, another's session.
+// RPC handlers and the rdma_cm thread share the table, so every access goes
+// through the lock; slow work (pinning memory, loading files) is done outside
+// it and only attached to the session afterwards. Likewise, an ended session
+// is taken out of the table under the lock but destroyed after it, since that
+// deregisters its memory and may unload its files.
+class session_table
+{
+  static constexpr auto connect_timeout_ = std::chrono::seconds{ 60 };
+
+  ibv_pd *const pd_;
+  file_registry &files_;
+  std::map<std::uint64_t, std::unique_ptr<session>> sessions_;
+  std::map<rdma_cm_id *, std::uint64_t> connections_;
+  std::mutex mutex_;
+  std::condition_variable stop_reaper_;
+  bool stopping_{ false };
+  std::thread reaper_;
+
+  static std::uint64_t RandomId()
+  {
+    std::uint64_t id = 0;
+    auto *p = reinterpret_cast<char *>(&id);
+    for (std::size_t n = 0; n < sizeof(id);) {
+      auto const r = getrandom(p + n, sizeof(id) - n, 0);
+      if (r < 0 && errno == EINTR) continue;
+      if (r < 0) throw std::runtime_error("getrandom() failed");
+      n += static_cast<std::size_t>(r);
+    }
+    return id;
+  }
+
+  void Reap()
+  {
+    std::unique_lock<std::mutex> lock{ mutex_ };
+    while (!stop_reaper_.wait_for(
+      lock, connect_timeout_ / 2, [this] { return stopping_; })) {
+      auto const now = std::chrono::steady_clock::now();
+      std::vector<std::unique_ptr<session>> expired;
+      for (auto it = sessions_.begin(); it != sessions_.end();) {
+        auto const &s = *it->second;
+        if (!s.connected && now - s.begun > connect_timeout_) {
+          spdlog::info("Session {} never connected", it->first);
+          expired.push_back(this->Remove(it++->first));
+        } else {
+          ++it;
+        }
+      }
+      lock.unlock();
+      expired.clear();
+      lock.lock();
+    }
+  }
+
+  session &Get(std::uint64_t const id)
+  {
+    auto it = sessions_.find(id);
+    if (it == sessions_.end())
+      throw std::out_of_range(fmt::format("no session {}", id));
+    return *it->second;
+  }
+
+  // Takes session id out of the table, for the caller to destroy once it has
+  // released the lock
+  std::unique_ptr<session> Remove(std::uint64_t const id)
+  {
+    auto it = sessions_.find(id);
+    if (it == sessions_.end()) return nullptr;
+    auto ended = std::move(it->second);
+    sessions_.erase(it);
+    spdlog::info("Session {} ended", id);
+    return ended;
+  }
+
+public:
+  session_table(ibv_pd *pd, file_registry &files)
+    : pd_{ pd }, files_{ files }, reaper_{ [this] { this->Reap(); } }
+  {}
+
+  ~session_table()
+  {
+    {
+      std::lock_guard<std::mutex> lock{ mutex_ };
+      stopping_ = true;
+    }
+    stop_reaper_.notify_all();
+    reaper_.join();
+  }
+
+  session_table &operator=(const session_table &) = delete;
+  session_table(const session_table &) = delete;
+
+  ibv_pd *ProtectionDomain() const noexcept { return pd_; }
+
+  std::uint64_t Begin()
+  {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    auto id = RandomId();
+    while (id == 0 || sessions_.count(id)) id = RandomId();
+    sessions_.emplace(id, std::make_unique<session>(files_));
+    spdlog::info("Session {} started", id);
+    return id;
+  }
+
+  void End(std::uint64_t const id)
+  {
+    std::unique_ptr<session> ended;
+    {
+      std::lock_guard<std::mutex> lock{ mutex_ };
+      ended = this->Remove(id);
+    }
+  }
+
+  region_info AllocateRegion(std::uint64_t const id, std::uint64_t const length)
+  {
+    {
+      std::lock_guard<std::mutex> lock{ mutex_ };
+      this->Get(id);
+    }
+    auto buffer =
+      std::make_unique<FAM::rdma::RdmaMemoryBuffer>(pd_, length, false, true);
+    region_info const info{
+      reinterpret_cast<std::uint64_t>(buffer->p.get()), length, buffer->mr->rkey
+    };
+
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    this->Get(id).client_regions.push_back(std::move(buffer));
+    return info;
+  }
+
+  // Unless progressive, waits for the whole file to be loaded
+  file_info MmapFile(std::uint64_t const id,
+    std::string const &path,
+    std::uint64_t const offset,
+    std::uint64_t const length,
+    bool const progressive)
+  {
+    {
+      std::lock_guard<std::mutex> lock{ mutex_ };
+      this->Get(id);
+    }
+    auto const [key, file] = files_.Acquire(path, offset, length);
+    auto const region = [](FAM::rdma::RdmaMemoryBuffer const &buffer,
+                          std::uint64_t const size) {
+      return region_info{
+        reinterpret_cast<std::uint64_t>(buffer.p.get()), size, buffer.mr->rkey
+      };
+    };
+    file_info const info{ region(*file->buffer, file->buffer->size),
+      region(*file->ready, file->chunks),
+      loaded_file::ChunkSize() };
+
+    try {
+      if (!progressive) file->Wait();
+    } catch (...) {
+      files_.Release(key);
+      throw;
+    }
+
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    auto it = sessions_.find(id);
+    if (it == sessions_.end()) {
+      files_.Release(key);
+      throw std::out_of_range(fmt::format("no session {}", id));
+    }
+    it->second->client_files.push_back(key);
+    it->second->mapped_files.emplace(info.data.addr, file);
+    return info;
+  }
+
+  // Copies [addrs[i], addrs[i] + lengths[i]) of a mapped file back to back
+  // into the session's staging region for slot, growing it if needed. Slots
+  // stand for the session's rdma connections and a gather may not stage more
+  // than the mapped file holds, so a client cannot grow staging unboundedly.
+  region_info Gather(std::uint64_t const id,
+    std::uint64_t const region,
+    std::uint32_t const slot,
+    std::vector<std::uint64_t> const &addrs,
+    std::vector<std::uint32_t> const &lengths)
+  {
+    if (addrs.size() != lengths.size())
+      throw std::invalid_argument("gather RPC: malformed ranges");
+    std::uint64_t total = 0;
+    for (auto const length : lengths) total += length;
+
+    std::shared_ptr<loaded_file> file;
+    std::shared_ptr<FAM::rdma::RdmaMemoryBuffer> staging;
+    {
+      std::lock_guard<std::mutex> lock{ mutex_ };
+      auto &s = this->Get(id);
+      auto it = s.mapped_files.find(region);
+      if (it == s.mapped_files.end())
+        throw std::invalid_argument("gather RPC: region is not a mapped file");
+      file = it->second;
+      if (slot >= s.connections)
+        throw std::invalid_argument("gather RPC: slot is not a connection");
+      if (total > file->buffer->size)
+        throw std::invalid_argument("gather RPC: more than the file holds");
+
+      auto &slot_buffer = s.staging[slot];
+      if (!slot_buffer || slot_buffer->size < total) {
+        slot_buffer = std::make_shared<FAM::rdma::RdmaMemoryBuffer>(
+          pd_, std::max<std::uint64_t>(total, 1), false, false);
+      }
+      staging = slot_buffer;
+    }
+
+    file->Wait();
+    auto const base = reinterpret_cast<std::uint64_t>(file->buffer->p.get());
+    auto const size = file->buffer->size;
+    auto out = static_cast<char *>(staging->p.get());
+    for (std::size_t i = 0; i < addrs.size(); ++i) {
+      // client supplied, so checked without any sum that could wrap
+      auto const off = addrs[i] - base;
+      if (addrs[i] < base || off > size || lengths[i] > size - off)
+        throw std::out_of_range("gather RPC: range is outside the file");
+      std::memcpy(out, reinterpret_cast<char const *>(addrs[i]), lengths[i]);
+      out += lengths[i];
+    }
+
+    auto const staged = reinterpret_cast<std::uint64_t>(staging->p.get());
+    return region_info{ staged, total, staging->mr->rkey };
+  }
+
+  bool Connect(rdma_cm_id *const id, std::uint64_t const session_id)
+  {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    auto it = sessions_.find(session_id);
+    if (it == sessions_.end()) return false;
+    ++it->second->connections;
+    it->second->connected = true;
+    connections_.emplace(id, session_id);
+    return true;
+  }
+
+  void Disconnect(rdma_cm_id *const id)
+  {
+    std::unique_ptr<session> ended;
+    {
+      std::lock_guard<std::mutex> lock{ mutex_ };
+      auto it = connections_.find(id);
+      if (it == connections_.end()) return;
+      auto const session_id = it->second;
+      connections_.erase(it);
+
+      auto s = sessions_.find(session_id);
+      if (s == sessions_.end()) return;
+      if (--s->second->connections == 0) {
+        spdlog::info("Session {} lost all connections", session_id);
+        ended = this->Remove(session_id);
+      }
+    }
+  }
 };
 
-void rdma_handle_event(rdma_cm_event const &event_copy, session &s)
+// Forgets a connection that failed or was never set up, and frees its id
+void rdma_drop_connection(rdma_cm_id *const id, session_table &sessions)
+{
+  sessions.Disconnect(id);
+  if (id->qp) rdma_destroy_qp(id);
+  rdma_destroy_id(id);
+}
+
+// Failures of a single connection are logged and cost only that connection's
+// client; only a failure of the event channel itself throws
+void rdma_handle_event(rdma_cm_event const &event_copy,
+  std::uint64_t const session_id,
+  session_table &sessions)
 {
   spdlog::debug(rdma_event_str(event_copy.event));
 
@@ -46,55 +607,74 @@ void rdma_handle_event(rdma_cm_event const &event_copy, session &s)
     qp_attr.cap.max_send_sge = 1;
     qp_attr.cap.max_recv_sge = 1;
     qp_attr.sq_sig_all = 0;// shouldn't need this explicitly
-    if (rdma_create_qp(event_copy.id, nullptr, &qp_attr))
-      throw std::runtime_error("rdma_create_qp() failed!");
-
-    auto params = FAM::rdma::RdmaConnParams();
-    auto const err = rdma_accept(event_copy.id, &params);
-    if (err) throw std::runtime_error("rdma_accept() failed!");
-
-    // spdlog::debug("id {} id->verbs {} id->pd {}",
-    //   (void *)(event_copy.id),
-    //   (void *)(event_copy.id)->verbs,
-    //   (void *)(event_copy.id)->pd);
+    auto const pd = sessions.ProtectionDomain();
+    if (event_copy.id->verbs != pd->context) {
+      spdlog::error("Rejecting connection on a different RDMA device");
+      rdma_reject(event_copy.id, nullptr, 0);
+      rdma_destroy_id(event_copy.id);
+      return;
+    }
+    if (!sessions.Connect(event_copy.id, session_id)) {
+      spdlog::error("Rejecting connection for unknown session {}", session_id);
+      rdma_reject(event_copy.id, nullptr, 0);
+      rdma_destroy_id(event_copy.id);
+      return;
+    }
+    if (rdma_create_qp(event_copy.id, pd, &qp_attr)) {
+      spdlog::error("rdma_create_qp() failed for session {}", session_id);
+      rdma_reject(event_copy.id, nullptr, 0);
+      rdma_drop_connection(event_copy.id, sessions);
+      return;
+    }
 
-    s.id->pd = event_copy.id->pd;// ->pd;// grab this if null in session
+    // reads we serve are bounded by those the client issues, and vice versa
+    auto params = FAM::rdma::RdmaConnParams(pd->context);
+    auto const &request = event_copy.param.conn;
+    params.responder_resources =
+      std::min(params.responder_resources, request.initiator_depth);
+    params.initiator_depth =
+      std::min(params.initiator_depth, request.responder_resources);
+    if (rdma_accept(event_copy.id, &params)) {
+      spdlog::error("rdma_accept() failed for session {}", session_id);
+      rdma_reject(event_copy.id, nullptr, 0);
+      rdma_drop_connection(event_copy.id, sessions);
+    }
   } else if (event_copy.event == RDMA_CM_EVENT_ESTABLISHED) {// Runs on both
 
   } else if (event_copy.event == RDMA_CM_EVENT_DISCONNECTED) {// Runs on both
     rdma_disconnect(event_copy.id);
-    rdma_destroy_qp(event_copy.id);
-    rdma_destroy_id(event_copy.id);
-  } else {
-    auto error = fmt::format(
-      "Unhandled rdma_cm event {}", rdma_event_str(event_copy.event));
-    throw std::runtime_error(error);
+    rdma_drop_connection(event_copy.id, sessions);
+  } else if (event_copy.event == RDMA_CM_EVENT_CONNECT_ERROR
+             || event_copy.event == RDMA_CM_EVENT_UNREACHABLE
+             || event_copy.event == RDMA_CM_EVENT_REJECTED) {
+    spdlog::error("Dropping connection: {}", rdma_event_str(event_copy.event));
+    rdma_drop_connection(event_copy.id, sessions);
+  } else if (event_copy.event == RDMA_CM_EVENT_DEVICE_REMOVAL) {
+    throw std::runtime_error("RDMA device removed");
+  } else {// e.g. ADDR_CHANGE, TIMEWAIT_EXIT
+    spdlog::debug(
+      "Ignoring rdma_cm event {}", rdma_event_str(event_copy.event));
   }
 }
 
-void rdma_server_loop(rdma_event_channel *const ec, session &s)
+// Runs on its own thread; rdma_get_cm_event blocks until the next event.
+void rdma_server_loop(rdma_event_channel *const ec, session_table &sessions)
 {
-  struct rdma_cm_event *event = NULL;
-
-  pollfd pfd;
-  nfds_t const n_fds = 1;
-  int const ms = 0;
-  pfd.fd = ec->fd;
-  pfd.events = POLLIN | POLLOUT | POLLPRI;
-
-  auto ret = poll(&pfd, n_fds, ms);
-
-  if (ret == -1) throw std::runtime_error("poll returned -1");
-
-  if (ret > 0) {
-    if (rdma_get_cm_event(ec, &event) == 0) {
-      struct rdma_cm_event event_copy;
-      memcpy(&event_copy, event, sizeof(*event));
-      rdma_ack_cm_event(event);
-      rdma_handle_event(event_copy, s);
-    } else {
+  while (true) {
+    struct rdma_cm_event *event = NULL;
+    if (rdma_get_cm_event(ec, &event))
       throw std::runtime_error("rdma_get_cm_event returnd non-zero");
-    }
+
+    struct rdma_cm_event event_copy;
+    memcpy(&event_copy, event, sizeof(*event));
+    // private data lives in the event, which the ack releases
+    std::uint64_t session_id = 0;
+    auto const &conn = event->param.conn;
+    if (event->event == RDMA_CM_EVENT_CONNECT_REQUEST
+        && conn.private_data_len >= sizeof(session_id))
+      memcpy(&session_id, conn.private_data, sizeof(session_id));
+    rdma_ack_cm_event(event);
+    rdma_handle_event(event_copy, session_id, sessions);
   }
 }
 
@@ -115,8 +695,12 @@ public:
     cq_->Shutdown();
   }
 
-  // There is no shutdown handling in this code.
-  void Run(std::string const &server_address, const uint64_t memserver_port)
+  // Serves until the rdma event channel fails, then stops the RPC workers
+  // and throws.
+  void Run(std::string const &server_address,
+    const uint64_t memserver_port,
+    std::vector<std::string> const &preload_files,
+    bool const retain_files)
   {
     ServerBuilder builder;
     builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
@@ -135,14 +719,13 @@ public:
     char *ip = inet_ntoa(reinterpret_cast<sockaddr_in *>(addr)->sin_addr);
     spdlog::debug("Server listening on IPoIB: {}:{}", ip, rdma_port);
 
-    session s{ id.get() };
+    auto pd = FAM::rdma::CreateProtectionDomain();
+    file_registry files{ pd.get(), retain_files };
+    for (auto const &file : preload_files) files.Preload(file);
 
-    // spdlog::debug("listen id {} id->verbs {} id->pd {}",
-    //   (void *)(s.id),
-    //   (void *)(s.id)->verbs,
-    //   (void *)(s.id)->pd);
+    session_table sessions{ pd.get(), files };
 
-    HandleRpcs(ec.get(), s);
+    HandleRpcs(ec.get(), sessions);
   }
 
 private:
@@ -185,13 +768,14 @@ private:
     fam::AllocateRegionRequest request_;
     fam::AllocateRegionReply reply_;
     ServerAsyncResponseWriter<fam::AllocateRegionReply> responder_;
-    session &s;
+    session_table &sessions_;
 
   public:
     AllocateRegionHandler(FAMController::AsyncService *service,
       ServerCompletionQueue *cq,
-      session &t_s)
-      : async_state_machine(service, cq), responder_(&ctx_), s{ t_s }
+      session_table &sessions)
+      : async_state_machine(service, cq), responder_(&ctx_),
+        sessions_{ sessions }
     {}
 
     void request() override
@@ -201,17 +785,14 @@ private:
     };
     void handle() override
     {
-      (new AllocateRegionHandler(service_, cq_, s))->Proceed();
+      (new AllocateRegionHandler(service_, cq_, sessions_))->Proceed();
 
-      auto const length = request_.size();
+      // another thread may pick up the Finish tag before we return
+      status_ = FINISH;
       try {
-        s.client_regions.push_back(
-          std::make_unique<FAM::rdma::RdmaMemoryBuffer>(
-            s.id, length, false, true));
-        auto const ptr =
-          reinterpret_cast<uint64_t>(s.client_regions.back()->p.get());
-        auto const rkey = s.client_regions.back()->mr->rkey;
-        reply_.set_addr(ptr);
+        auto const [addr, length, rkey] =
+          sessions_.AllocateRegion(request_.session_id(), request_.size());
+        reply_.set_addr(addr);
         reply_.set_length(length);
         reply_.set_rkey(rkey);
 
@@ -222,7 +803,6 @@ private:
           this);
         spdlog::error("Region creation failed!");
       }
-      status_ = FINISH;
     }
   };
 
@@ -231,13 +811,14 @@ private:
     fam::MmapFileRequest request_;
     fam::MmapFileReply reply_;
     ServerAsyncResponseWriter<fam::MmapFileReply> responder_;
-    session &s;
+    session_table &sessions_;
 
   public:
     MmapFileHandler(FAMController::AsyncService *service,
       ServerCompletionQueue *cq,
-      session &t_s)
-      : async_state_machine(service, cq), responder_(&ctx_), s{ t_s }
+      session_table &sessions)
+      : async_state_machine(service, cq), responder_(&ctx_),
+        sessions_{ sessions }
     {}
 
     void request() override
@@ -246,32 +827,111 @@ private:
     };
     void handle() override
     {
-      (new MmapFileHandler(service_, cq_, s))->Proceed();
+      (new MmapFileHandler(service_, cq_, sessions_))->Proceed();
 
-      auto const filename = request_.path();
-      auto const length = FAM::Util::file_size(filename);
+      status_ = FINISH;
+      try {
+        auto const [data, ready, chunk_size] =
+          sessions_.MmapFile(request_.session_id(),
+            request_.path(),
+            request_.offset(),
+            request_.length(),
+            request_.progressive());
+        reply_.set_addr(data.addr);
+        reply_.set_length(data.length);
+        reply_.set_rkey(data.rkey);
+        reply_.set_ready_addr(ready.addr);
+        reply_.set_ready_rkey(ready.rkey);
+        reply_.set_chunk_size(chunk_size);
 
+        responder_.Finish(reply_, Status::OK, this);
+      } catch (std::exception const &e) {
+        responder_.Finish(reply_,
+          Status(grpc::StatusCode::ABORTED, "rdma region create failed"),
+          this);
+        spdlog::error("Region creation failed!");
+      }
+    }
+  };
+
+  class FileSizeHandler : public async_state_machine
+  {
+    fam::FileSizeRequest request_;
+    fam::FileSizeReply reply_;
+    ServerAsyncResponseWriter<fam::FileSizeReply> responder_;
+
+  public:
+    FileSizeHandler(FAMController::AsyncService *service,
+      ServerCompletionQueue *cq)
+      : async_state_machine(service, cq), responder_(&ctx_)
+    {}
+
+    void request() override
+    {
+      service_->RequestFileSize(&ctx_, &request_, &responder_, cq_, cq_, this);
+    };
+    void handle() override
+    {
+      (new FileSizeHandler(service_, cq_))->Proceed();
+
+      status_ = FINISH;
       try {
-        s.client_regions.push_back(
-          std::make_unique<FAM::rdma::RdmaMemoryBuffer>(
-            s.id, length, false, true));
-        auto const ptr = s.client_regions.back()->p.get();
-        auto const rkey = s.client_regions.back()->mr->rkey;
+        reply_.set_length(FAM::Util::file_size(request_.path()));
+        responder_.Finish(reply_, Status::OK, this);
+      } catch (std::exception const &e) {
+        responder_.Finish(
+          reply_, Status(grpc::StatusCode::NOT_FOUND, e.what()), this);
+        spdlog::error("FileSize failed: {}", e.what());
+      }
+    }
+  };
 
-        FAM::Util::copy_file(ptr, filename, length);
+  class GatherHandler : public async_state_machine
+  {
+    fam::GatherRequest request_;
+    fam::GatherReply reply_;
+    ServerAsyncResponseWriter<fam::GatherReply> responder_;
+    session_table &sessions_;
+
+  public:
+    GatherHandler(FAMController::AsyncService *service,
+      ServerCompletionQueue *cq,
+      session_table &sessions)
+      : async_state_machine(service, cq), responder_(&ctx_),
+        sessions_{ sessions }
+    {}
+
+    void request() override
+    {
+      service_->RequestGather(&ctx_, &request_, &responder_, cq_, cq_, this);
+    };
+    void handle() override
+    {
+      (new GatherHandler(service_, cq_, sessions_))->Proceed();
 
-        reply_.set_addr(reinterpret_cast<uint64_t>(ptr));
+      status_ = FINISH;
+      try {
+        std::vector<std::uint64_t> const addrs(
+          request_.addrs().begin(), request_.addrs().end());
+        std::vector<std::uint32_t> const lengths(
+          request_.lengths().begin(), request_.lengths().end());
+        auto const [addr, length, rkey] =
+          sessions_.Gather(request_.session_id(),
+            request_.region(),
+            request_.slot(),
+            addrs,
+            lengths);
+        reply_.set_addr(addr);
         reply_.set_length(length);
         reply_.set_rkey(rkey);
 
         responder_.Finish(reply_, Status::OK, this);
       } catch (std::exception const &e) {
         responder_.Finish(reply_,
-          Status(grpc::StatusCode::ABORTED, "rdma region create failed"),
+          Status(grpc::StatusCode::INVALID_ARGUMENT, e.what()),
           this);
-        spdlog::error("Region creation failed!");
+        spdlog::error("Gather failed: {}", e.what());
       }
-      status_ = FINISH;
     }
   };
 
@@ -298,18 +958,48 @@ private:
     }
   };
 
+  class BeginSessionHandler : public async_state_machine
+  {
+    fam::BeginSessionRequest request_;
+    fam::BeginSessionReply reply_;
+    ServerAsyncResponseWriter<fam::BeginSessionReply> responder_;
+    session_table &sessions_;
+
+  public:
+    BeginSessionHandler(FAMController::AsyncService *service,
+      ServerCompletionQueue *cq,
+      session_table &sessions)
+      : async_state_machine(service, cq), responder_(&ctx_),
+        sessions_{ sessions }
+    {}
+
+    void request() override
+    {
+      service_->RequestBeginSession(
+        &ctx_, &request_, &responder_, cq_, cq_, this);
+    };
+    void handle() override
+    {
+      (new BeginSessionHandler(service_, cq_, sessions_))->Proceed();
+      reply_.set_session_id(sessions_.Begin());
+      status_ = FINISH;
+      responder_.Finish(reply_, Status::OK, this);
+    }
+  };
+
   class EndSessionHandler : public async_state_machine
   {
     fam::EndSessionRequest request_;
     fam::EndSessionReply reply_;
     ServerAsyncResponseWriter<fam::EndSessionReply> responder_;
-    session &s;
+    session_table &sessions_;
 
   public:
     EndSessionHandler(FAMController::AsyncService *service,
       ServerCompletionQueue *cq,
-      session &t_s)
-      : async_state_machine(service, cq), responder_(&ctx_), s{ t_s }
+      session_table &sessions)
+      : async_state_machine(service, cq), responder_(&ctx_),
+        sessions_{ sessions }
     {}
 
     void request() override
@@ -319,34 +1009,52 @@ private:
     };
     void handle() override
     {
-      (new EndSessionHandler(service_, cq_, s))->Proceed();
-      this->s.client_regions.clear();
+      (new EndSessionHandler(service_, cq_, sessions_))->Proceed();
+      sessions_.End(request_.session_id());
       status_ = FINISH;
       responder_.Finish(reply_, Status::OK, this);
     }
   };
 
-  void HandleRpcs(rdma_event_channel *ec, session &s)
+  void HandleRpcs(rdma_event_channel *ec, session_table &sessions)
   {
-    using namespace std::literals;
-
-    (new AllocateRegionHandler(&service_, cq_.get(), s))->Proceed();
+    (new AllocateRegionHandler(&service_, cq_.get(), sessions))->Proceed();
     (new PingHandler(&service_, cq_.get()))->Proceed();
-    (new EndSessionHandler(&service_, cq_.get(), s))->Proceed();
-    (new MmapFileHandler(&service_, cq_.get(), s))->Proceed();
-    void *tag;// uniquely identifies a request.
-    bool ok;
-    while (true) {
-      auto const deadline = std::chrono::system_clock::now();
-      auto const ret = cq_->AsyncNext(&tag, &ok, deadline);
-
-      if (ret == grpc::CompletionQueue::NextStatus::GOT_EVENT) {
-        GPR_ASSERT(ok);
-        static_cast<async_state_machine *>(tag)->Proceed();
-      }
+    (new BeginSessionHandler(&service_, cq_.get(), sessions))->Proceed();
+    (new EndSessionHandler(&service_, cq_.get(), sessions))->Proceed();
+    (new MmapFileHandler(&service_, cq_.get(), sessions))->Proceed();
+    (new FileSizeHandler(&service_, cq_.get()))->Proceed();
+    (new GatherHandler(&service_, cq_.get(), sessions))->Proceed();
+
+    // Every handler re-arms itself before doing any work, so a slow MmapFile
+    // on one worker leaves the others free to serve Ping, AllocateRegion, ...
+    auto const n_workers = std::max(2u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    for (auto i = 0u; i < n_workers; ++i) {
+      workers.emplace_back([this] {
+        void *tag;// uniquely identifies a request.
+        bool ok;
+        while (cq_->Next(&tag, &ok)) {
+          // a call that could not complete, e.g. at shutdown
+          if (!ok) {
+            delete static_cast<async_state_machine *>(tag);
+            continue;
+          }
+          static_cast<async_state_machine *>(tag)->Proceed();
+        }
+      });
+    }
 
-      rdma_server_loop(ec, s);
+    // the workers use sessions, so they are stopped before it goes away
+    try {
+      rdma_server_loop(ec, sessions);
+    } catch (...) {
+      server_->Shutdown();
+      cq_->Shutdown();
+      for (auto &worker : workers) worker.join();
+      throw;
     }
+    for (auto &worker : workers) worker.join();
   }
 
   std::unique_ptr<ServerCompletionQueue> cq_;
@@ -357,9 +1065,14 @@ private:
 
 void FAM::server::RunServer(std::string const &host,
   std::string const &port,
-  const uint64_t memserver_port)
+  const uint64_t memserver_port,
+  std::vector<std::string> const &preload_files,
+  bool const retain_files)
 {
   spdlog::set_level(spdlog::level::debug);
   ServerImpl server;
-  server.Run(fmt::format("{}:{}", host, port), memserver_port);
+  server.Run(fmt::format("{}:{}", host, port),
+    memserver_port,
+    preload_files,
+    retain_files);
 }
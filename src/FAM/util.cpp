@@ -3,6 +3,10 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <tuple>
 
 #include <spdlog/spdlog.h>
 
@@ -22,13 +26,14 @@ class file_mapper
 {
   constexpr static uint64_t default_chunk = 10UL * (1 << 30);// 30 GB
   uint64_t const chunk_size{ default_chunk };
-  uint64_t offset{ 0 };
-  uint64_t filesize;
+  uint64_t offset;
+  uint64_t end;
   int fd;
 
 public:
-  file_mapper(std::string const &file, uint64_t t_fsize)
-    : filesize{ t_fsize }, fd{ open(file.c_str(), O_RDONLY) }
+  file_mapper(std::string const &file, uint64_t t_offset, uint64_t t_length)
+    : offset{ t_offset }, end{ t_offset + t_length }, fd{ open(file.c_str(),
+                                                        O_RDONLY) }
   {
     if (this->fd == -1) {
       throw std::runtime_error("open() failed on .adj file");
@@ -40,24 +45,32 @@ public:
   file_mapper(const file_mapper &) = delete;
   file_mapper &operator=(const file_mapper &) = delete;
 
-  bool has_next() noexcept { return this->offset < this->filesize; }
+  bool has_next() noexcept { return this->offset < this->end; }
 
+  // mmap() offsets must be page aligned, so the mapping may start before
+  // the requested offset; the returned pointer skips the extra prefix.
   auto operator()()
   {
-    auto length = std::min(this->chunk_size, this->filesize - this->offset);
-    auto del = [length](void *p) {
-      auto r = munmap(p, length);
+    static auto const page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    auto const length = std::min(this->chunk_size, this->end - this->offset);
+    auto const map_offset = this->offset & ~(page - 1);
+    auto const skew = this->offset - map_offset;
+    auto const map_length = length + skew;
+    auto del = [map_length](void *p) {
+      auto r = munmap(p, map_length);
       if (r) throw std::runtime_error("munmap chunk failed");
     };
 
     auto constexpr flags = MAP_PRIVATE | MAP_POPULATE;
     auto ptr = mmap(
-      0, length, PROT_READ, flags, this->fd, static_cast<long>(this->offset));
+      0, map_length, PROT_READ, flags, this->fd, static_cast<long>(map_offset));
     this->offset += length;
 
     if (ptr == MAP_FAILED) throw std::runtime_error("mmap file chunk failed");
 
-    return make_pair(std::unique_ptr<void, decltype(del)>(ptr, del), length);
+    auto const data = static_cast<char const *>(ptr) + skew;
+    return std::make_tuple(
+      std::unique_ptr<void, decltype(del)>(ptr, del), data, length);
   }
 };
 }// namespace
@@ -92,16 +105,28 @@ uint64_t FAM::Util::file_size(std::string const &file)
   return fs::file_size(p);
 }
 
+std::time_t FAM::Util::file_mtime(std::string const &file)
+{
+  namespace fs = boost::filesystem;
+
+  fs::path p(file);
+  if (!(fs::exists(p) && fs::is_regular_file(p)))
+    throw std::runtime_error("mmap RPC: requested file not found");
+
+  return fs::last_write_time(p);
+}
+
 void FAM::Util::copy_file(void *dest,
   std::string const &file,
-  uint64_t const filesize)
+  uint64_t const offset,
+  uint64_t const length)
 {
   auto array = reinterpret_cast<char *>(dest);
-  file_mapper get_mapped_chunk{ file, filesize };
+  file_mapper get_mapped_chunk{ file, offset, length };
 
   while (get_mapped_chunk.has_next()) {
-    auto const [fptr, len] = get_mapped_chunk();
-    std::memcpy(array, fptr.get(), len);
+    auto const [mapping, fptr, len] = get_mapped_chunk();
+    std::memcpy(array, fptr, len);
     array += len;
   }
 }
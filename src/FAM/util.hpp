@@ -4,6 +4,7 @@
 #include <memory>
 #include <functional>
 #include <string>
+#include <ctime>
 
 namespace FAM {
 namespace Util {
@@ -11,7 +12,11 @@ namespace Util {
     mmap(std::uint64_t const size, bool const use_HP);
 
   uint64_t file_size(std::string const &file);
-  void copy_file(void *dest, std::string const &file, uint64_t const filesize);
+  std::time_t file_mtime(std::string const &file);
+  void copy_file(void *dest,
+    std::string const &file,
+    uint64_t const offset,
+    uint64_t const length);
 }// namespace Util
 }// namespace FAM
 
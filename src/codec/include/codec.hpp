@@ -64,6 +64,27 @@ struct DeltaDecompressor
     }
   }
 
+  // Decodes the block starting at block and returns the word following it
+  template<typename Function>
+  static uint32_t const *DecompressBlock(uint32_t const *block,
+    Function const& f,
+    uint32_t degree) noexcept
+  {
+    auto const b = famgraph::tools::Block::Unpack(block[0]);
+    switch (b.delta_size) {
+    case 1:
+      Apply<uint8_t>(block + 1, b.num_vals, f, degree);
+      break;
+    case 2:
+      Apply<uint16_t>(block + 1, b.num_vals, f, degree);
+      break;
+    case 4:
+      Apply<uint32_t>(block + 1, b.num_vals, f, degree);
+      break;
+    }
+    return block + b.AlignedWords();
+  }
+
   template<typename Function>
   static void
     Decompress(uint32_t const *buffer, uint64_t n, Function const& f) noexcept
@@ -72,22 +93,7 @@ struct DeltaDecompressor
     auto *end = buffer + n;
     auto const degree = buffer[0];
     auto *p = buffer + 1;
-    while (p < end) {
-      auto const packed_block = p[0];
-      auto const b = famgraph::tools::Block::Unpack(packed_block);
-      switch (b.delta_size) {
-      case 1:
-        Apply<uint8_t>(p + 1, b.num_vals, f, degree);
-        break;
-      case 2:
-        Apply<uint16_t>(p + 1, b.num_vals, f, degree);
-        break;
-      case 4:
-        Apply<uint32_t>(p + 1, b.num_vals, f, degree);
-        break;
-      }
-      p += b.AlignedWords();
-    }
+    while (p < end) { p = DecompressBlock(p, f, degree); }
   }
 };
 }// namespace famgraph::tools
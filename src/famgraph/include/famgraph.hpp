@@ -2,9 +2,20 @@
 #define __FAMGRAPH_H__
 
 #include <range/v3/all.hpp>
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
 #include <cstring>
 #include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <fgidx.hpp>
 #include <FAM.hpp>
 #include <FAM_constants.hpp>
@@ -107,36 +118,385 @@ public:
 
 void PrintVertexSubset(VertexSubset const& vertex_subset) noexcept;
 
+struct MemoryServer
+{
+  std::string grpc_addr;
+  std::string ipoib_addr;
+  std::string ipoib_port;
+};
+
+// Splits [first, end) into parts vertex ranges holding about the same number
+// of adjacency words. Returns the first vertex of every range, then end.
+inline std::vector<VertexLabel> SplitByEdges(fgidx::DenseIndex const& idx,
+  VertexLabel first,
+  VertexLabel end,
+  std::size_t parts)
+{
+  std::vector<VertexLabel> cuts{ first };
+  if (end > first) {
+    auto const first_edge = idx[first].begin;
+    auto const edges = idx[end - 1].end_exclusive - first_edge;
+    for (std::size_t k = 1; k < parts; ++k) {
+      auto const target = first_edge + edges * k / parts;
+      auto lo = static_cast<std::uint64_t>(cuts.back());
+      auto hi = static_cast<std::uint64_t>(end);
+      while (lo < hi) {
+        auto const mid = lo + (hi - lo) / 2;
+        if (idx[static_cast<VertexLabel>(mid)].begin < target)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      cuts.push_back(static_cast<VertexLabel>(lo));
+    }
+  }
+  cuts.push_back(end);
+  return cuts;
+}
+
+// Like SplitByEdges, counting only the adjacency words of vertices in subset.
+// Cuts fall on multiples of 64 vertices past first, the words of the subset
+// bitmap.
+inline std::vector<VertexLabel> SplitByActiveEdges(fgidx::DenseIndex const& idx,
+  VertexSubset const& subset,
+  VertexLabel first,
+  VertexLabel end,
+  std::size_t parts)
+{
+  constexpr std::uint64_t run = 64;
+  auto const runs = (std::uint64_t{ end } - first + run - 1) / run;
+  std::vector<EdgeIndexType> work(runs);
+  tbb::parallel_for(tbb::blocked_range<std::uint64_t>{ 0, runs },
+    [&](auto const& my_runs) {
+      for (auto k = my_runs.begin(); k < my_runs.end(); ++k) {
+        auto const run_end =
+          std::min<std::uint64_t>(first + (k + 1) * run, end);
+        EdgeIndexType words = 0;
+        for (auto v = first + k * run; v < run_end; ++v) {
+          auto const vertex = static_cast<VertexLabel>(v);
+          if (!subset[vertex]) continue;
+          auto const [begin, end_exclusive] = idx[vertex];
+          words += end_exclusive - begin;
+        }
+        work[k] = words;
+      }
+    });
+  std::partial_sum(work.begin(), work.end(), work.begin());
+
+  std::vector<VertexLabel> cuts{ first };
+  auto const total = work.empty() ? 0 : work.back();
+  for (std::size_t k = 1; k < parts && total > 0; ++k) {
+    auto const target = total * k / parts;
+    auto const j = static_cast<std::uint64_t>(
+      std::lower_bound(work.begin(), work.end(), target) - work.begin());
+    auto const cut = static_cast<VertexLabel>(
+      std::min<std::uint64_t>(first + (j + 1) * run, end));
+    if (cut > cuts.back()) cuts.push_back(cut);
+  }
+  if (cuts.back() != end) cuts.push_back(end);
+  return cuts;
+}
+
+struct RemoteGraphOptions
+{
+  // Batches of at least this many segments are packed by the memory server
+  // (FamControl::Gather) and fetched with a single read instead of one work
+  // request per segment. 0 disables gathering.
+  std::size_t gather_threshold = 0;
+  // Segments this many bytes apart or closer are read by one work request,
+  // the bytes in between discarded (see FAM::CoalescePolicy). Capped by what
+  // the memory servers' devices allow; 0 only merges adjacent segments.
+  std::uint32_t coalesce_gap = 0;
+  // Size of one channel's edge window, in words of the adjacency file (edges
+  // of an uncompressed graph). Longer adjacency lists are read in chunks of
+  // this size (see RemoteGraph::EdgeMapHub). For compressed graphs it must
+  // hold the largest block plus the degree word; CreateInstance reads the
+  // lists that exceed it once to check, and throws if it does not. 0 sizes
+  // windows to the longest list.
+  std::uint64_t chunk_edges = 0;
+  // Batches one EdgeMap task keeps reading at a time, each on a channel of
+  // its own, so that a few threads can keep many reads outstanding
+  std::size_t batches_in_flight = 1;
+  // Reads go through the I/O thread of each memory server's FamControl
+  // (FamControl::Submit), which coalesces adjacent lists of different tasks,
+  // instead of being posted on the task's channel. Channels then only stand
+  // for parts of the edge window. Gathered batches are still posted.
+  bool io_thread = false;
+  // Edge weights, one word per word of an uncompressed adjacency file (see
+  // edgelist2fg --weighted), for EdgeMapWeighted. Mapped next to the lists.
+  std::string weights_file;
+};
+
+// Hands out the RDMA channels of a graph, and the part of the edge window
+// each of them reads into, to tasks for as long as they use them. A task
+// waits while every channel is leased, so a graph can have fewer channels
+// than threads as well as more, and a task may hold several. Tasks that
+// already hold a channel should only TryAcquire more.
+class ChannelPool
+{
+  tbb::concurrent_bounded_queue<int> free_;
+
+public:
+  explicit ChannelPool(int channels)
+  {
+    for (int channel = 0; channel < channels; ++channel) free_.push(channel);
+  }
+
+  class Lease
+  {
+    ChannelPool *pool_;
+    int channel_;
+
+  public:
+    Lease(ChannelPool *pool, int channel) : pool_{ pool }, channel_{ channel }
+    {}
+    Lease(Lease const&) = delete;
+    Lease& operator=(Lease const&) = delete;
+    Lease(Lease&& other) noexcept
+      : pool_{ std::exchange(other.pool_, nullptr) },
+        channel_{ other.channel_ }
+    {}
+    Lease& operator=(Lease&& other) noexcept
+    {
+      if (this != &other) {
+        this->Release();
+        this->pool_ = std::exchange(other.pool_, nullptr);
+        this->channel_ = other.channel_;
+      }
+      return *this;
+    }
+    ~Lease() { this->Release(); }
+
+    void Release() noexcept
+    {
+      if (this->pool_ != nullptr) this->pool_->free_.push(this->channel_);
+      this->pool_ = nullptr;
+    }
+
+    int Channel() const noexcept { return this->channel_; }
+  };
+
+  // Yields rather than sleeps while every channel is leased: holders only
+  // read and traverse, so one comes back soon, and a sleeping worker would
+  // be lost to the task scheduler meanwhile
+  Lease Acquire()
+  {
+    while (true) {
+      int channel;
+      if (this->free_.try_pop(channel)) return Lease{ this, channel };
+      std::this_thread::yield();
+    }
+  }
+
+  std::optional<Lease> TryAcquire()
+  {
+    int channel;
+    if (!this->free_.try_pop(channel)) return std::nullopt;
+    return Lease{ this, channel };
+  }
+};
+
 template<typename Decompressor = NopDecompressor> class RemoteGraph
 {
+  // A range of vertices whose adjacency lists are mapped on one memory server
+  struct Partition
+  {
+    VertexLabel first_vertex;
+    EdgeIndexType first_edge;
+    FAM::FamControl *fam_control;
+    FAM::FamControl::RemoteRegion adjacency_array;
+    std::uint32_t lkey;// edge window as registered with fam_control
+    FAM::FamControl::RemoteRegion weights;// empty for unweighted graphs
+    std::uint32_t weight_lkey;
+  };
+
   fgidx::DenseIndex const idx_;
-  std::unique_ptr<FAM::FamControl> fam_control_;
-  FAM::FamControl::RemoteRegion const adjacency_array_;
+  std::vector<std::unique_ptr<FAM::FamControl>> fam_controls_;
+  std::vector<Partition> partitions_;
   FAM::FamControl::LocalRegion edge_window_;
+  FAM::FamControl::LocalRegion weight_window_;
+  int const rdma_channels_;
+  std::unique_ptr<ChannelPool> channel_pool_;
+  RemoteGraphOptions const options_;
+  FAM::CoalescePolicy const coalesce_;
+  std::unique_ptr<std::atomic<bool>> gather_failed_;
+  // of every vertex of a compressed graph, see ReadDegrees; empty otherwise
+  std::vector<uint32_t> const degrees_;
 
   RemoteGraph(fgidx::DenseIndex&& idx,
-    std::unique_ptr<FAM::FamControl>&& fam_control,
-    FAM::FamControl::RemoteRegion adjacency_array,
-    FAM::FamControl::LocalRegion edge_window)
-    : idx_{ std::move(idx) }, fam_control_{ std::move(fam_control) },
-      adjacency_array_{ adjacency_array }, edge_window_{ edge_window }
+    std::vector<std::unique_ptr<FAM::FamControl>>&& fam_controls,
+    std::vector<Partition>&& partitions,
+    FAM::FamControl::LocalRegion edge_window,
+    FAM::FamControl::LocalRegion weight_window,
+    int rdma_channels,
+    RemoteGraphOptions options,
+    std::vector<uint32_t>&& degrees)
+    : idx_{ std::move(idx) }, fam_controls_{ std::move(fam_controls) },
+      partitions_{ std::move(partitions) }, edge_window_{ edge_window },
+      weight_window_{ weight_window },
+      rdma_channels_{ rdma_channels },
+      channel_pool_{ std::make_unique<ChannelPool>(rdma_channels) },
+      options_{ options },
+      coalesce_{ CoalescePolicyFor(fam_controls_, options) },
+      gather_failed_{ std::make_unique<std::atomic<bool>>(false) },
+      degrees_{ std::move(degrees) }
   {}
 
-  void PostSegmentsAndWait(std::vector<FAM::FamSegment> const& segments,
-    std::uint32_t taken,
+  static FAM::CoalescePolicy CoalescePolicyFor(
+    std::vector<std::unique_ptr<FAM::FamControl>> const& fam_controls,
+    RemoteGraphOptions const& options) noexcept
+  {
+    FAM::CoalescePolicy policy{ options.coalesce_gap,
+      FAM::max_scatter_entries };
+    for (auto const& fam_control : fam_controls) {
+      auto const max = fam_control->MaxCoalescePolicy();
+      policy.max_gap = std::min(policy.max_gap, max.max_gap);
+      policy.max_sge = std::min(policy.max_sge, max.max_sge);
+    }
+    return policy;
+  }
+
+  // Split [0, v_max] into one vertex range per server, each holding roughly
+  // the same number of edges. Returns the first vertex of every range.
+  static std::vector<VertexLabel> PartitionVertices(
+    fgidx::DenseIndex const& idx,
+    std::size_t servers)
+  {
+    auto first_vertices = SplitByEdges(idx, 0, idx.v_max + 1, servers);
+    first_vertices.pop_back();
+    return first_vertices;
+  }
+
+  Partition const& PartitionOf(VertexLabel v) const noexcept
+  {
+    auto it = std::upper_bound(partitions_.begin(),
+      partitions_.end(),
+      v,
+      [](VertexLabel x, Partition const& p) { return x < p.first_vertex; });
+    return *std::prev(it);
+  }
+
+  VertexLabel PartitionEnd(Partition const& partition) const noexcept
+  {
+    auto const next = &partition + 1;
+    return next == partitions_.data() + partitions_.size() ? idx_.v_max + 1
+                                                           : next->first_vertex;
+  }
+
+  // Reads n words of the adjacency array from first on into the channel
+  // buffer. They must be mapped by partition.
+  uint32_t const *ReadAndWait(Partition const& partition,
+    EdgeIndexType first,
+    EdgeIndexType n,
     int channel) noexcept
   {
-    auto const [buffer, unused] = this->GetChannelBuffer(channel);
-    auto *edges = static_cast<uint32_t volatile *>(buffer);
-    auto const end = taken - 1;
-    edges[0] = famgraph::null_vert;
-    edges[end] = famgraph::null_vert;
-    auto const rkey = this->adjacency_array_.rkey;
-    auto const lkey = this->edge_window_.lkey;
-    this->fam_control_->Read(
-      buffer, segments, lkey, rkey, static_cast<unsigned long>(channel));
-    while (
-      edges[0] == famgraph::null_vert || edges[end] == famgraph::null_vert) {}
+    [[maybe_unused]] auto const [buffer, unused] =
+      this->GetChannelBuffer(channel);
+    auto const raddr = partition.adjacency_array.raddr
+                       + (first - partition.first_edge) * sizeof(VertexLabel);
+    auto const ticket = partition.fam_control->Read(buffer,
+      raddr,
+      static_cast<std::uint32_t>(n * sizeof(VertexLabel)),
+      partition.lkey,
+      partition.adjacency_array.rkey,
+      static_cast<unsigned long>(channel));
+    partition.fam_control->Wait(ticket);
+    return static_cast<uint32_t const *>(buffer);
+  }
+
+  // Reads the weights of n adjacency words from first on into the channel's
+  // weight buffer
+  uint32_t const *ReadWeightsAndWait(Partition const& partition,
+    EdgeIndexType first,
+    EdgeIndexType n,
+    int channel) noexcept
+  {
+    [[maybe_unused]] auto const [buffer, unused] =
+      this->GetWeightBuffer(channel);
+    auto const raddr = partition.weights.raddr
+                       + (first - partition.first_edge) * sizeof(uint32_t);
+    auto const ticket = partition.fam_control->Read(buffer,
+      raddr,
+      static_cast<std::uint32_t>(n * sizeof(uint32_t)),
+      partition.weight_lkey,
+      partition.weights.rkey,
+      static_cast<unsigned long>(channel));
+    partition.fam_control->Wait(ticket);
+    return static_cast<uint32_t const *>(buffer);
+  }
+
+  // Weights sit at the same offsets in their file as the adjacency words do
+  // in theirs, so the segments of a batch translate one to one. They land
+  // back to back in the weight buffer, in step with the words.
+  FAM::FamControl::Ticket PostWeights(std::vector<FAM::FamSegment> segments,
+    Partition const& partition,
+    int channel) noexcept
+  {
+    [[maybe_unused]] auto const [buffer, unused] =
+      this->GetWeightBuffer(channel);
+    auto const offset =
+      partition.weights.raddr - partition.adjacency_array.raddr;
+    for (auto& segment : segments) segment.raddr += offset;
+    return partition.fam_control->Read(buffer,
+      segments,
+      partition.weight_lkey,
+      partition.weights.rkey,
+      FAM::CoalescePolicy{},
+      static_cast<unsigned long>(channel));
+  }
+
+  FAM::FamControl::Ticket PostSegments(
+    std::vector<FAM::FamSegment> const& segments,
+    Partition const& partition,
+    int channel) noexcept
+  {
+    [[maybe_unused]] auto const [buffer, unused] =
+      this->GetChannelBuffer(channel);
+    auto const rkey = partition.adjacency_array.rkey;
+    auto const lkey = partition.lkey;
+    return partition.fam_control->Read(buffer,
+      segments,
+      lkey,
+      rkey,
+      this->coalesce_,
+      static_cast<unsigned long>(channel));
+  }
+
+  // The server packs the segments before the read is posted, so only the
+  // read is asynchronous. Empty if the server did not gather them, in which
+  // case gathering is off for the rest of the graph's life and the caller
+  // reads the segments itself.
+  std::optional<FAM::FamControl::Ticket> GatherSegments(
+    std::vector<FAM::FamSegment> const& segments,
+    Partition const& partition,
+    int channel) noexcept
+  {
+    if (this->gather_failed_->load(std::memory_order_relaxed))
+      return std::nullopt;
+    [[maybe_unused]] auto const [buffer, unused] =
+      this->GetChannelBuffer(channel);
+    auto const staged = partition.fam_control->Gather(
+      partition.adjacency_array, segments, static_cast<std::uint32_t>(channel));
+    if (!staged) {
+      this->gather_failed_->store(true, std::memory_order_relaxed);
+      return std::nullopt;
+    }
+    return partition.fam_control->Read(buffer,
+      staged->raddr,
+      static_cast<std::uint32_t>(staged->length),
+      partition.lkey,
+      staged->rkey,
+      static_cast<unsigned long>(channel));
+  }
+
+  // Segment count from which a batch is gathered. Batches larger than one
+  // post can take are always gathered once gathering is on.
+  std::size_t GatherThreshold() const noexcept
+  {
+    auto const threshold = this->options_.gather_threshold;
+    if (threshold == 0 || this->gather_failed_->load(std::memory_order_relaxed))
+      return 0;
+    return std::min(threshold, FAM::max_outstanding_wr + 1);
   }
 
 
@@ -145,76 +505,583 @@ template<typename Decompressor = NopDecompressor> class RemoteGraph
     VertexLabel v;
   };
 
+  // A batch whose read was posted on the leased channel, or submitted to the
+  // I/O thread into the leased channel's buffer. EdgeMap continues with its
+  // traversal once the ticket, or every submitted fetch, completes.
+  struct Batch
+  {
+    ChannelPool::Lease lease;
+    std::vector<SegmentDescriptor> descriptors;
+    Partition const *partition;
+    FAM::FamControl::Ticket ticket;
+    std::unique_ptr<std::atomic<std::uint32_t>> pending;
+
+    bool IsComplete() const noexcept
+    {
+      if (this->pending)
+        return this->pending->load(std::memory_order_acquire) == 0;
+      return this->partition->fam_control->IsComplete(this->ticket);
+    }
+  };
+
+  // Hands the segments to the I/O thread of the partition's FamControl,
+  // which may merge them with those of other tasks. They land back to back
+  // in the channel buffer, as with PostSegments, and their weights in the
+  // weight buffer if asked for, as with PostWeights.
+  std::unique_ptr<std::atomic<std::uint32_t>> SubmitSegments(
+    std::vector<FAM::FamSegment> const& segments,
+    Partition const& partition,
+    int channel,
+    bool with_weights = false) noexcept
+  {
+    [[maybe_unused]] auto const [buffer, unused] =
+      this->GetChannelBuffer(channel);
+    auto pending = std::make_unique<std::atomic<std::uint32_t>>(
+      static_cast<std::uint32_t>(segments.size() * (with_weights ? 2 : 1)));
+    auto *laddr = static_cast<char *>(buffer);
+    for (auto const& [raddr, length] : segments) {
+      partition.fam_control->Submit({ laddr,
+        raddr,
+        length,
+        partition.lkey,
+        partition.adjacency_array.rkey,
+        pending.get() });
+      laddr += length;
+    }
+    if (!with_weights) return pending;
+
+    [[maybe_unused]] auto const [weight_buffer, weight_length] =
+      this->GetWeightBuffer(channel);
+    auto const offset =
+      partition.weights.raddr - partition.adjacency_array.raddr;
+    laddr = static_cast<char *>(weight_buffer);
+    for (auto const& [raddr, length] : segments) {
+      partition.fam_control->Submit({ laddr,
+        raddr + offset,
+        length,
+        partition.weight_lkey,
+        partition.weights.rkey,
+        pending.get() });
+      laddr += length;
+    }
+    return pending;
+  }
+
+  // Weighted batches pass f the weight of every edge as well, from the
+  // channel's weight buffer
+  template<bool Weighted, typename Function>
+  void Traverse(Function& f, Batch const& batch) const noexcept
+  {
+    auto const channel = batch.lease.Channel();
+    [[maybe_unused]] auto const [buffer, length] =
+      this->GetChannelBuffer(channel);
+    [[maybe_unused]] auto const [weight_buffer, weight_length] =
+      this->GetWeightBuffer(channel);
+    auto b = static_cast<uint32_t const *>(buffer);
+    auto weights = static_cast<uint32_t const *>(weight_buffer);
+    for (auto const [v] : batch.descriptors) {
+      auto const [start_inclusive, end_exclusive] = this->idx_[v];
+      auto const num_edges = end_exclusive - start_inclusive;
+      if constexpr (Weighted) {
+        for (EdgeIndexType i = 0; i < num_edges; ++i)
+          f(v, b[i], weights[i], num_edges);
+        weights += num_edges;
+      } else {
+        Decompressor::Decompress(b,
+          num_edges,
+          [&](uint32_t dst, uint32_t degree) { f(v, dst, degree); });
+      }
+      b += num_edges;
+    }
+  }
+
+  template<bool Weighted, typename Function>
+  void Drain(Function& f, std::vector<Batch>& batches) noexcept
+  {
+    for (auto const& batch : batches) {
+      while (!batch.IsComplete()) {}
+      this->template Traverse<Weighted>(f, batch);
+    }
+    batches.clear();
+  }
+
+  // Segments of one batch never span partitions, so each batch is served by
+  // a single memory server. A batch takes at most max_requests work requests
+  // when read with policy. It ends before the first adjacency list that does
+  // not fit in a channel window; that vertex is returned as the hub, or
+  // null_vert if there is none.
   template<typename Range>
   std::tuple<std::vector<SegmentDescriptor>,
     std::vector<FAM::FamSegment>,
-    std::uint32_t>
-    GetSegments(Range r) noexcept
+    std::uint32_t,
+    Partition const *,
+    VertexLabel>
+    GetSegments(Range r,
+      std::size_t max_requests,
+      FAM::CoalescePolicy policy) noexcept
   {
     [[maybe_unused]] auto const [unused, length] = this->GetChannelBuffer(0);
     auto const capacity = length / sizeof(VertexLabel);
     std::vector<SegmentDescriptor> descriptors;
     std::vector<FAM::FamSegment> segments;
     std::uint32_t taken = 0;
-    VertexLabel last_taken = 0;
+    std::size_t requests = 0;
+    std::uint32_t sges = 0;// scatter entries of the current request
+    Partition const *partition = nullptr;
+    VertexLabel partition_end = 0;
     for (auto const v : r) {
-      auto const is_continue = (v == last_taken + 1) && segments.size() != 0;
       auto const [start_inclusive, end_exclusive] = this->idx_[v];
       auto const edges = static_cast<uint32_t>(end_exclusive - start_inclusive);
       if (edges == 0) continue;
+      if (edges > capacity)
+        return std::tuple(descriptors, segments, taken, partition, v);
       if (taken + edges > capacity) break;
+      if (partition == nullptr) {
+        partition = &this->PartitionOf(v);
+        partition_end = this->PartitionEnd(*partition);
+      }
+      if (v >= partition_end) break;
 
       auto const length2 = edges * static_cast<uint32_t>(sizeof(VertexLabel));
+      auto const raddr =
+        partition->adjacency_array.raddr
+        + (start_inclusive - partition->first_edge) * sizeof(VertexLabel);
+      auto const end = segments.empty()
+                         ? raddr + 1
+                         : segments.back().raddr + segments.back().length;
 
-      if (is_continue) {
+      if (raddr == end) {
         segments.back().length += length2;
         taken += edges;
-        last_taken = v;
         descriptors.push_back({ v });
         continue;
       }
 
-      if (segments.size() >= FAM::max_outstanding_wr) break;
+      if (raddr > end && policy.Joins(raddr - end, sges)) {
+        sges += 2;
+      } else {
+        if (requests >= max_requests) break;
+        ++requests;
+        sges = 1;
+      }
 
-      auto const raddr =
-        this->adjacency_array_.raddr + start_inclusive * sizeof(VertexLabel);
       segments.push_back({ raddr, length2 });
       taken += edges;
-      last_taken = v;
       descriptors.push_back({ v });
     }
 
-    return std::tuple(descriptors, segments, taken);
+    return std::tuple(descriptors, segments, taken, partition, null_vert);
+  }
+
+  // Adjacency lists longer than a channel window are read a window at a time,
+  // on the caller's lease. Uncompressed lists are cut into window sized
+  // chunks that are fetched and traversed as separate tasks, so that idle
+  // threads share the work of a hub; a chunk task reads on a channel of its
+  // own if one is free and takes turns on the caller's otherwise, so it never
+  // waits for the pool. The chunk loop runs isolated: while the caller waits
+  // for it, still holding its lease, its thread must not pick up an outer
+  // EdgeMap task that would Acquire and wait for that very lease. Compressed
+  // lists can only be cut where a block ends, which is known once the
+  // preceding block is read: every read resumes at the first block the
+  // previous one did not hold whole.
+  template<typename Function>
+  void EdgeMapHub(Function& f, VertexLabel v, ChannelPool::Lease const& lease)
+  {
+    auto const [start_inclusive, end_exclusive] = this->idx_[v];
+    auto const& partition = this->PartitionOf(v);
+    [[maybe_unused]] auto const [unused, length] = this->GetChannelBuffer(0);
+    EdgeIndexType const chunk = length / sizeof(VertexLabel);
+
+    if constexpr (std::is_same_v<Decompressor, tools::DeltaDecompressor>) {
+      auto const channel = lease.Channel();
+      auto next = start_inclusive;
+      auto const *words = this->ReadAndWait(partition, next, chunk, channel);
+      auto const degree = words[0];
+      auto const *p = words + 1;
+      while (true) {
+        auto const *end = words + std::min(chunk, end_exclusive - next);
+        auto const *block = p;
+        while (block < end
+               && block + tools::Block::Unpack(block[0]).AlignedWords()
+                    <= end) {
+          block = Decompressor::DecompressBlock(
+            block,
+            [&](uint32_t dst, uint32_t d) { f(v, dst, d); },
+            degree);
+        }
+        // CreateInstance made sure a window holds any block whole, so every
+        // read makes progress
+        next += static_cast<EdgeIndexType>(block - words);
+        if (next == end_exclusive) return;
+        words = this->ReadAndWait(
+          partition, next, std::min(chunk, end_exclusive - next), channel);
+        p = words;
+      }
+    } else {
+      auto const degree = end_exclusive - start_inclusive;
+      auto const chunks = (degree + chunk - 1) / chunk;
+      std::mutex shared;// guards the caller's channel
+      tbb::this_task_arena::isolate([&] {
+        tbb::parallel_for(tbb::blocked_range<EdgeIndexType>{ 0, chunks, 1 },
+          [&](auto const& my_chunks) {
+            auto const own = this->channel_pool_->TryAcquire();
+            std::unique_lock<std::mutex> lock{ shared, std::defer_lock };
+            if (!own) lock.lock();
+            auto const channel = own ? own->Channel() : lease.Channel();
+            for (auto k = my_chunks.begin(); k < my_chunks.end(); ++k) {
+              auto const first = start_inclusive + k * chunk;
+              auto const n = std::min(chunk, end_exclusive - first);
+              auto const *edges =
+                this->ReadAndWait(partition, first, n, channel);
+              for (EdgeIndexType i = 0; i < n; ++i) f(v, edges[i], degree);
+            }
+          });
+      });
+    }
+  }
+
+  // Walks the blocks of every compressed list longer than a window of
+  // window_edges words, a window at a time as EdgeMapHub does, and throws
+  // unless each read holds at least the block it starts with. Reads go to
+  // the first channel's part of window, which nothing else uses yet.
+  static void CheckBlocksFit(fgidx::DenseIndex const& index,
+    std::vector<Partition> const& partitions,
+    FAM::FamControl::LocalRegion const& window,
+    EdgeIndexType window_edges)
+  {
+    auto const words = static_cast<uint32_t const *>(window.laddr);
+    for (auto const& partition : partitions) {
+      auto const next_partition = &partition + 1;
+      auto const partition_end =
+        next_partition == partitions.data() + partitions.size()
+          ? index.v_max + 1
+          : next_partition->first_vertex;
+      for (auto v = partition.first_vertex; v < partition_end; ++v) {
+        auto const [start_inclusive, end_exclusive] = index[v];
+        if (end_exclusive - start_inclusive <= window_edges) continue;
+        auto next = start_inclusive;
+        EdgeIndexType skip = 1;// the degree word
+        while (next < end_exclusive) {
+          auto const n = std::min(window_edges, end_exclusive - next);
+          auto const ticket = partition.fam_control->Read(window.laddr,
+            partition.adjacency_array.raddr
+              + (next - partition.first_edge) * sizeof(VertexLabel),
+            static_cast<std::uint32_t>(n * sizeof(VertexLabel)),
+            partition.lkey,
+            partition.adjacency_array.rkey,
+            0);
+          partition.fam_control->Wait(ticket);
+          auto const *block = words + skip;
+          while (block < words + n
+                 && block + tools::Block::Unpack(block[0]).AlignedWords()
+                      <= words + n) {
+            block += tools::Block::Unpack(block[0]).AlignedWords();
+          }
+          if (block == words + skip) {
+            auto const needed =
+              block < words + n
+                ? skip + tools::Block::Unpack(block[0]).AlignedWords()
+                : skip + 1;
+            throw std::runtime_error(
+              "RemoteGraph: chunk_edges must be at least "
+              + std::to_string(needed) + " for this graph");
+          }
+          next += static_cast<EdgeIndexType>(block - words);
+          skip = 0;
+        }
+      }
+    }
+  }
+
+  // A compressed list starts with the degree of its vertex. CreateInstance
+  // reads all of them, four bytes per vertex kept locally, so that Degree
+  // needs no channel: every channel reads the first words of a range of
+  // vertices into its part of window, a batch at a time.
+  static std::vector<uint32_t> ReadDegrees(fgidx::DenseIndex const& index,
+    std::vector<Partition> const& partitions,
+    FAM::FamControl::LocalRegion const& window,
+    EdgeIndexType window_edges,
+    int rdma_channels)
+  {
+    auto const vertices = static_cast<std::uint64_t>(index.v_max) + 1;
+    auto const channels = static_cast<std::uint64_t>(rdma_channels);
+    auto const batch_size =
+      std::min<std::uint64_t>(window_edges, FAM::max_outstanding_wr);
+    std::vector<uint32_t> degrees(vertices, 0);
+    tbb::parallel_for(std::uint64_t{ 0 }, channels, [&](std::uint64_t c) {
+      auto *const buffer =
+        static_cast<uint32_t *>(window.laddr) + c * window_edges;
+      auto v = static_cast<VertexLabel>(vertices * c / channels);
+      auto const end = static_cast<VertexLabel>(vertices * (c + 1) / channels);
+      std::vector<VertexLabel> batch;
+      std::vector<FAM::FamSegment> segments;
+      while (v < end) {
+        batch.clear();
+        segments.clear();
+        Partition const *partition = nullptr;
+        VertexLabel partition_end = 0;
+        for (; v < end && batch.size() < batch_size; ++v) {
+          auto const [start_inclusive, end_exclusive] = index[v];
+          if (end_exclusive == start_inclusive) continue;
+          if (partition == nullptr) {
+            auto const it = std::upper_bound(partitions.begin(),
+              partitions.end(),
+              v,
+              [](VertexLabel x, Partition const& p) {
+                return x < p.first_vertex;
+              });
+            partition = &*std::prev(it);
+            partition_end =
+              it == partitions.end() ? index.v_max + 1 : it->first_vertex;
+          }
+          if (v >= partition_end) break;
+          batch.push_back(v);
+          segments.push_back({ partition->adjacency_array.raddr
+                                 + (start_inclusive - partition->first_edge)
+                                     * sizeof(VertexLabel),
+            static_cast<std::uint32_t>(sizeof(uint32_t)) });
+        }
+        if (batch.empty()) continue;
+        auto const ticket = partition->fam_control->Read(buffer,
+          segments,
+          partition->lkey,
+          partition->adjacency_array.rkey,
+          FAM::CoalescePolicy{},
+          static_cast<unsigned long>(c));
+        partition->fam_control->Wait(ticket);
+        for (std::size_t i = 0; i < batch.size(); ++i)
+          degrees[batch[i]] = buffer[i];
+      }
+    });
+    return degrees;
+  }
+
+  template<typename Function>
+  void EdgeMapWeightedHub(Function& f, VertexLabel v, int channel)
+  {
+    auto const [start_inclusive, end_exclusive] = this->idx_[v];
+    auto const& partition = this->PartitionOf(v);
+    [[maybe_unused]] auto const [unused, length] = this->GetChannelBuffer(0);
+    EdgeIndexType const chunk = length / sizeof(VertexLabel);
+    auto const degree = end_exclusive - start_inclusive;
+    for (auto first = start_inclusive; first < end_exclusive; first += chunk) {
+      auto const n = std::min(chunk, end_exclusive - first);
+      auto const *edges = this->ReadAndWait(partition, first, n, channel);
+      auto const *weights =
+        this->ReadWeightsAndWait(partition, first, n, channel);
+      for (EdgeIndexType i = 0; i < n; ++i) f(v, edges[i], weights[i], degree);
+    }
+  }
+
+  // The batched traversal behind EdgeMap and EdgeMapWeighted. Weighted
+  // batches read the weights of their lists as well, on the same channel or
+  // through the I/O thread. They are never gathered, and each of their two
+  // reads takes at most half of the channel's work requests.
+  template<bool Weighted, typename Function, typename Filter>
+  void EdgeMapBatches(Function& f,
+    Filter const& is_active,
+    ranges::iota_view<std::uint32_t, std::uint32_t> range)
+  {
+    if (range.empty()) return;
+    auto next_start = range.front();
+    auto const last = range.back();
+    auto const gather_threshold = Weighted ? 0 : this->GatherThreshold();
+    // gathered batches are packed by the server, whatever their layout
+    auto const max_requests = Weighted ? FAM::max_outstanding_wr / 2
+                              : gather_threshold == 0
+                                ? FAM::max_outstanding_wr
+                                : std::numeric_limits<std::size_t>::max();
+    // gathered, submitted and weighted batches must not have gaps
+    auto const coalesce =
+      !Weighted && gather_threshold == 0 && !this->options_.io_thread
+        ? this->coalesce_
+        : FAM::CoalescePolicy{};
+    auto const max_batches =
+      std::max<std::size_t>(1, this->options_.batches_in_flight);
+    std::vector<Batch> batches;
+    batches.reserve(max_batches);
+    auto done = false;
+    while (true) {
+      // 1) post reads for as many batches as there are channels for
+      while (!done && batches.size() < max_batches) {
+        auto lease = batches.empty()
+                       ? std::optional{ this->channel_pool_->Acquire() }
+                       : this->channel_pool_->TryAcquire();
+        if (!lease) break;
+
+        auto r = ranges::views::iota(next_start, last + 1)
+                 | ranges::views::filter(is_active);
+        auto [descriptors, segments, taken, partition, hub] =
+          this->GetSegments(r, max_requests, coalesce);
+        if (segments.empty()) {
+          if (hub == null_vert) {
+            done = true;
+            break;
+          }
+          this->template Drain<Weighted>(f, batches);
+          if constexpr (Weighted)
+            this->EdgeMapWeightedHub(f, hub, lease->Channel());
+          else
+            this->EdgeMapHub(f, hub, *lease);
+          next_start = hub + 1;
+          continue;
+        }
+
+        next_start = descriptors.back().v + 1;
+        auto const channel = lease->Channel();
+        Batch batch{
+          std::move(*lease), std::move(descriptors), partition, {}, nullptr
+        };
+        std::optional<FAM::FamControl::Ticket> gathered;
+        if (gather_threshold != 0 && segments.size() >= gather_threshold)
+          gathered = this->GatherSegments(segments, *partition, channel);
+        if (gathered) {
+          batch.ticket = *gathered;
+        } else if (this->options_.io_thread) {
+          batch.pending =
+            this->SubmitSegments(segments, *partition, channel, Weighted);
+        } else {
+          batch.ticket = this->PostSegments(segments, *partition, channel);
+          // posted after the lists on the same channel, so done after them
+          if constexpr (Weighted)
+            batch.ticket = this->PostWeights(segments, *partition, channel);
+        }
+        batches.push_back(std::move(batch));
+      }
+      if (batches.empty()) return;
+
+      // 2) traverse the first batch to arrive
+      auto ready = batches.begin();
+      while (!ready->IsComplete()) {
+        if (++ready == batches.end()) ready = batches.begin();
+      }
+      this->template Traverse<Weighted>(f, *ready);
+      batches.erase(ready);
+    }
   }
 
+
 public:
   static auto CreateInstance(std::string const& index_file,
     std::string const& adj_file,
-    std::string const& grpc_addr,
-    std::string const& ipoib_addr,
-    std::string const& ipoib_port,
-    int rdma_channels)
+    std::vector<MemoryServer> const& memory_servers,
+    int rdma_channels,
+    RemoteGraphOptions options = {})
   {
-    auto fam_control = std::make_unique<FAM::FamControl>(
-      grpc_addr, ipoib_addr, ipoib_port, rdma_channels);
-    auto const adjacency_file = fam_control->MmapRemoteFile(adj_file);
-    uint64_t const edges = adjacency_file.length / sizeof(uint32_t);
+    if (memory_servers.empty())
+      throw std::runtime_error("RemoteGraph needs at least one memory server");
+
+    std::vector<std::unique_ptr<FAM::FamControl>> fam_controls;
+    for (auto const& server : memory_servers) {
+      fam_controls.push_back(std::make_unique<FAM::FamControl>(server.grpc_addr,
+        server.ipoib_addr,
+        server.ipoib_port,
+        rdma_channels,
+        options.io_thread));
+    }
+
+    auto const adj_bytes = fam_controls.front()->FileSize(adj_file);
+    uint64_t const edges = adj_bytes / sizeof(uint32_t);
 
     auto index = fgidx::DenseIndex::CreateInstance(index_file, edges);
 
-    auto const edge_window_size = index.max_out_degree
+    auto const window_edges =
+      options.chunk_edges == 0
+        ? index.max_out_degree
+        : std::min<std::uint64_t>(index.max_out_degree, options.chunk_edges);
+    auto const edge_window_size = window_edges
                                   * static_cast<unsigned long>(rdma_channels)
                                   * sizeof(uint32_t);
     auto const edge_window =
-      fam_control->CreateRegion(edge_window_size, false, true);
-
-    return RemoteGraph{
-      std::move(index), std::move(fam_control), adjacency_file, edge_window
+      fam_controls.front()->CreateRegion(edge_window_size, false, true);
+    auto const weighted = !options.weights_file.empty();
+    auto const weight_window =
+      weighted
+        ? fam_controls.front()->CreateRegion(edge_window_size, false, true)
+        : FAM::FamControl::LocalRegion{ nullptr, 0, 0 };
+    if (weighted
+        && fam_controls.front()->FileSize(options.weights_file) != adj_bytes)
+      throw std::runtime_error("RemoteGraph: weights do not match the edges");
+
+    auto const first_vertices =
+      PartitionVertices(index, fam_controls.size());
+    auto const edge_offset = [&](std::size_t k) {
+      auto const v = k < first_vertices.size() ? first_vertices[k]
+                                               : index.v_max + 1;
+      return v > index.v_max ? edges : index[v].begin;
     };
+    std::vector<Partition> partitions;
+    for (std::size_t k = 0; k < fam_controls.size(); ++k) {
+      auto const first_edge = edge_offset(k);
+      auto const end_edge = edge_offset(k + 1);
+      if (end_edge == first_edge) continue;
+
+      auto& fam_control = fam_controls[k];
+      auto const adjacency_array = fam_control->MmapRemoteFile(adj_file,
+        first_edge * sizeof(uint32_t),
+        (end_edge - first_edge) * sizeof(uint32_t));
+      auto const lkey =
+        k == 0 ? edge_window.lkey
+               : fam_control
+                   ->RegisterRegion(edge_window.laddr, edge_window_size, true)
+                   .lkey;
+      Partition partition{ first_vertices[k],
+        first_edge,
+        fam_control.get(),
+        adjacency_array,
+        lkey,
+        { 0, 0, 0 },
+        0 };
+      if (weighted) {
+        partition.weights = fam_control->MmapRemoteFile(options.weights_file,
+          first_edge * sizeof(uint32_t),
+          (end_edge - first_edge) * sizeof(uint32_t));
+        partition.weight_lkey =
+          k == 0 ? weight_window.lkey
+                 : fam_control
+                     ->RegisterRegion(
+                       weight_window.laddr, edge_window_size, true)
+                     .lkey;
+      }
+      partitions.push_back(partition);
+    }
+    std::vector<uint32_t> degrees;
+    if constexpr (std::is_same_v<Decompressor, tools::DeltaDecompressor>) {
+      if (window_edges < index.max_out_degree)
+        CheckBlocksFit(index, partitions, edge_window, window_edges);
+      degrees = ReadDegrees(
+        index, partitions, edge_window, window_edges, rdma_channels);
+    }
+
+    return RemoteGraph{ std::move(index),
+      std::move(fam_controls),
+      std::move(partitions),
+      edge_window,
+      weight_window,
+      rdma_channels,
+      options,
+      std::move(degrees) };
+  }
+
+  static auto CreateInstance(std::string const& index_file,
+    std::string const& adj_file,
+    std::string const& grpc_addr,
+    std::string const& ipoib_addr,
+    std::string const& ipoib_port,
+    int rdma_channels,
+    RemoteGraphOptions options = {})
+  {
+    return CreateInstance(index_file,
+      adj_file,
+      { MemoryServer{ grpc_addr, ipoib_addr, ipoib_port } },
+      rdma_channels,
+      options);
   }
 
   uint32_t max_v() const noexcept { return this->idx_.v_max; }
 
+  fgidx::DenseIndex const& Index() const noexcept { return this->idx_; }
+
   famgraph::EdgeIndexType Degree(VertexLabel v) const noexcept
   {
     auto interval = this->idx_[v];
@@ -232,49 +1099,36 @@ public:
     auto const& edge_window = this->edge_window_;
     auto *p = static_cast<char *>(edge_window.laddr);
     auto const length =
-      (edge_window.length
-        / static_cast<unsigned long>(this->fam_control_->rdma_channels_));
+      (edge_window.length / static_cast<unsigned long>(this->rdma_channels_));
+
+    return { p + length * static_cast<unsigned long>(channel), length };
+  }
+
+  // The weights of what was read into GetChannelBuffer(channel)
+  Buffer GetWeightBuffer(int channel) const noexcept
+  {
+    auto const& weight_window = this->weight_window_;
+    auto *p = static_cast<char *>(weight_window.laddr);
+    auto const length =
+      (weight_window.length / static_cast<unsigned long>(this->rdma_channels_));
 
     return { p + length * static_cast<unsigned long>(channel), length };
   }
 
+  // Every batch is read and traversed on a channel leased from the graph's
+  // pool; f must not wait on other tasks that need one. Chunks of lists that
+  // exceed a channel window may be traversed concurrently (see EdgeMapHub).
+  //
+  // Up to RemoteGraphOptions::batches_in_flight batches are read at a time,
+  // each on a channel of its own: the first one is waited for, the others
+  // are only taken when a channel is free. Whichever read completes first
+  // is traversed, and its channel goes on to the next batch.
   template<typename Function, typename Filter>
-  void EdgeMap(Function f,
+  void EdgeMap(Function& f,
     Filter const& is_active,
-    ranges::iota_view<std::uint32_t, std::uint32_t> range,
-    int channel = 0)
+    ranges::iota_view<std::uint32_t, std::uint32_t> range)
   {
-    if (range.empty()) return;
-    auto next_start = range.front();
-    auto const last = range.back();
-    while (next_start <= last) {
-      // 1) build up vector of intervals
-      auto r = ranges::views::iota(next_start, last + 1)
-               | ranges::views::filter(is_active);
-
-      auto const [descriptors, segments, taken] = this->GetSegments(r);
-      if (segments.empty()) return;
-      if (taken == 0) return;// need return here?... no we don't
-
-      next_start = descriptors.back().v + 1;
-
-      // 2) post the RDMA request
-      this->PostSegmentsAndWait(segments, taken, channel);
-      // 3) traverse the vector
-      [[maybe_unused]] auto const [buffer, length] =
-        this->GetChannelBuffer(channel);
-      auto b = static_cast<uint32_t *>(buffer);
-      for (auto const [v] : descriptors) {
-        auto const [start_inclusive, end_exclusive] = this->idx_[v];
-        auto const num_edges = end_exclusive - start_inclusive;
-        Decompressor::Decompress(b,
-          num_edges,
-          [&](uint32_t dst, uint32_t degree) { f(v, dst, degree); });
-        //        for (unsigned int i = 0; i < num_edges; ++i) f(v, b[i],
-        //        num_edges);
-        b += num_edges;
-      }
-    }
+    this->template EdgeMapBatches<false>(f, is_active, range);
   }
 
   template<typename Function>
@@ -287,11 +1141,10 @@ public:
   template<typename Function>
   void EdgeMap(Function& F,
     VertexSubset const& subset,
-    ranges::iota_view<std::uint32_t, std::uint32_t> range,
-    int channel = 0)
+    ranges::iota_view<std::uint32_t, std::uint32_t> range)
   {
     auto is_active = [&](auto v) { return subset[v]; };
-    this->EdgeMap(F, is_active, range, channel);
+    this->EdgeMap(F, is_active, range);
   }
 
   template<typename Function> void EdgeMap(Function& F)
@@ -299,38 +1152,48 @@ public:
     auto is_active = [](auto) { return true; };
     this->EdgeMap(F, is_active, { 0, this->max_v() + 1 });
   }
+
+  // f(v, w, weight, degree) for every edge of every active vertex in range.
+  // Needs RemoteGraphOptions::weights_file. Batches are read and traversed
+  // as by EdgeMap, each reading its adjacency lists and their weights.
+  template<typename Function, typename Filter>
+  void EdgeMapWeighted(Function& f,
+    Filter const& is_active,
+    ranges::iota_view<std::uint32_t, std::uint32_t> range)
+  {
+    static_assert(std::is_same_v<Decompressor, NopDecompressor>,
+      "weighted graphs must be uncompressed");
+    this->template EdgeMapBatches<true>(f, is_active, range);
+  }
+
+  template<typename Function>
+  void EdgeMapWeighted(Function& F,
+    VertexSubset const& subset,
+    ranges::iota_view<std::uint32_t, std::uint32_t> range)
+  {
+    auto is_active = [&](auto v) { return subset[v]; };
+    this->EdgeMapWeighted(F, is_active, range);
+  }
 };
 
 template<>
 inline famgraph::EdgeIndexType RemoteGraph<tools::DeltaDecompressor>::Degree(
   famgraph::VertexLabel v) const noexcept
 {
-  auto interval = this->idx_[v];
-  if (interval.end_exclusive - interval.begin == 0) return 0;
-  auto const channel = tbb::this_task_arena::current_thread_index();
-  [[maybe_unused]] auto const [buffer, unused] =
-    this->GetChannelBuffer(channel);
-  uint32_t constexpr magic = 0xFFFFFFFF;
-  uint32_t volatile *p = reinterpret_cast<uint32_t volatile *>(buffer);
-  *p = magic;
-  auto const l = sizeof(uint32_t);
-  auto const rkey = this->adjacency_array_.rkey;
-  auto const lkey = this->edge_window_.lkey;
-  auto const raddr =
-    this->adjacency_array_.raddr + interval.begin * sizeof(VertexLabel);
-  this->fam_control_->Read(buffer, raddr, l, lkey, rkey, channel);
-  while (*p == magic) {}
-  return *p;
+  return this->degrees_[v];
 }
 
 template<typename Decompressor = NopDecompressor> class LocalGraph
 {
   fgidx::DenseIndex idx_;
   std::unique_ptr<uint32_t[]> adjacency_array_;
+  std::unique_ptr<uint32_t[]> weights_;
 
   LocalGraph(fgidx::DenseIndex&& idx,
-    std::unique_ptr<uint32_t[]>&& adjacency_array)
-    : idx_(std::move(idx)), adjacency_array_(std::move(adjacency_array))
+    std::unique_ptr<uint32_t[]>&& adjacency_array,
+    std::unique_ptr<uint32_t[]>&& weights = nullptr)
+    : idx_(std::move(idx)), adjacency_array_(std::move(adjacency_array)),
+      weights_(std::move(weights))
   {}
 
 public:
@@ -342,9 +1205,27 @@ public:
       std::move(array) };
   }
 
+  // A weighted graph: weights_file holds one weight per adjacency word
+  static LocalGraph CreateInstance(std::string const& index_file,
+    std::string const& adj_file,
+    std::string const& weights_file)
+  {
+    static_assert(std::is_same_v<Decompressor, NopDecompressor>,
+      "weighted graphs must be uncompressed");
+    auto [edges, array] = fgidx::CreateAdjacencyArray(adj_file);
+    auto [weight_count, weights] = fgidx::CreateAdjacencyArray(weights_file);
+    if (weight_count != edges)
+      throw std::runtime_error("LocalGraph: weights do not match the edges");
+    return { fgidx::DenseIndex::CreateInstance(index_file, edges),
+      std::move(array),
+      std::move(weights) };
+  }
+
 
   uint32_t max_v() const noexcept { return this->idx_.v_max; }
 
+  fgidx::DenseIndex const& Index() const noexcept { return this->idx_; }
+
   famgraph::EdgeIndexType Degree(famgraph::VertexLabel v) const noexcept
   {
     auto interval = this->idx_[v];
@@ -378,8 +1259,7 @@ public:
   template<typename Function>
   void EdgeMap(Function& F,
     VertexSubset const& subset,
-    ranges::iota_view<std::uint32_t, std::uint32_t> range,
-    int /*channel*/ = 0)
+    ranges::iota_view<std::uint32_t, std::uint32_t> range)
   {
     auto is_active = [&](auto v) { return subset[v]; };
     this->EdgeMap(F, is_active, range);
@@ -390,6 +1270,32 @@ public:
     auto is_active = [](auto) { return true; };
     this->EdgeMap(F, is_active, { 0, this->max_v() + 1 });
   }
+
+  // f(v, w, weight, degree) for every edge of every active vertex in range
+  template<typename Function, typename Filter>
+  void EdgeMapWeighted(Function& f,
+    Filter const& is_active,
+    ranges::iota_view<std::uint32_t, std::uint32_t> range)
+  {
+    static_assert(std::is_same_v<Decompressor, NopDecompressor>,
+      "weighted graphs must be uncompressed");
+    for (auto const v : range | ranges::views::filter(is_active)) {
+      auto const [start_inclusive, end_exclusive] = this->idx_[v];
+      auto const num_edges = end_exclusive - start_inclusive;
+      for (auto i = start_inclusive; i < end_exclusive; ++i) {
+        f(v, this->adjacency_array_[i], this->weights_[i], num_edges);
+      }
+    }
+  }
+
+  template<typename Function>
+  void EdgeMapWeighted(Function& F,
+    VertexSubset const& subset,
+    ranges::iota_view<std::uint32_t, std::uint32_t> range)
+  {
+    auto is_active = [&](auto v) { return subset[v]; };
+    this->EdgeMapWeighted(F, is_active, range);
+  }
 };
 
 template<>
@@ -436,29 +1342,89 @@ public:
   }
 };
 
+// How EdgeMap cuts its vertex range into tasks: by vertex count, into
+// ranges with about as many adjacency words, or into ranges with about as
+// many adjacency words of active vertices. The latter costs a pass over the
+// subset but keeps sparse frontiers balanced.
+enum class EdgeBalance { VERTICES, ALL_EDGES, ACTIVE_EDGES };
+
+// Tasks per thread an edge balanced EdgeMap creates, leaving room for work
+// stealing to even out what the adjacency words do not account for
+constexpr std::size_t edge_map_tasks_per_thread = 8;
+
+// Calls map_range(first, end) in parallel on vertex ranges covering range,
+// cut as balance says
+template<typename Graph, typename RangeFunction>
+void ForEachBalancedRange(Graph& graph,
+  VertexSubset const& subset,
+  tbb::blocked_range<VertexLabel> const& range,
+  EdgeBalance balance,
+  RangeFunction const& map_range)
+{
+  if (balance == EdgeBalance::VERTICES) {
+    tbb::parallel_for(range, [&](auto const my_range) {
+      map_range(my_range.begin(), my_range.end());
+    });
+    return;
+  }
+
+  auto const parts = edge_map_tasks_per_thread
+                     * static_cast<std::size_t>(
+                       tbb::this_task_arena::max_concurrency());
+  auto const cuts =
+    balance == EdgeBalance::ALL_EDGES
+      ? SplitByEdges(graph.Index(), range.begin(), range.end(), parts)
+      : SplitByActiveEdges(
+        graph.Index(), subset, range.begin(), range.end(), parts);
+  tbb::parallel_for(tbb::blocked_range<std::size_t>{ 0, cuts.size() - 1, 1 },
+    [&](auto const my_parts) {
+      for (auto k = my_parts.begin(); k < my_parts.end(); ++k) {
+        map_range(cuts[k], cuts[k + 1]);
+      }
+    });
+}
+
 template<typename Graph, typename VertexProgram>
 void EdgeMap(Graph& graph,
   VertexSubset const& subset,
   VertexProgram& f,
-  tbb::blocked_range<VertexLabel> const& range) noexcept
+  tbb::blocked_range<VertexLabel> const& range,
+  EdgeBalance balance = EdgeBalance::ALL_EDGES) noexcept
 {
-  tbb::parallel_for(range, [&](auto const my_range) {
-    auto const channel = tbb::this_task_arena::current_thread_index();
-    graph.EdgeMap(f,
-      subset,
-      ranges::iota_view{ my_range.begin(), my_range.end() },
-      channel);
-  });
+  ForEachBalancedRange(
+    graph, subset, range, balance, [&](VertexLabel first, VertexLabel end) {
+      graph.EdgeMap(f, subset, ranges::iota_view{ first, end });
+    });
 }
 
 
 template<typename Graph, typename VertexProgram>
 void EdgeMap(Graph& graph,
   VertexSubset const& subset,
-  VertexProgram& f) noexcept
+  VertexProgram& f,
+  EdgeBalance balance = EdgeBalance::ALL_EDGES) noexcept
 {
-  EdgeMap(
-    graph, subset, f, tbb::blocked_range<VertexLabel>{ 0, graph.max_v() + 1 });
+  EdgeMap(graph,
+    subset,
+    f,
+    tbb::blocked_range<VertexLabel>{ 0, graph.max_v() + 1 },
+    balance);
+}
+
+// f(v, w, weight, degree) on a weighted adjacency graph
+template<typename Graph, typename VertexProgram>
+void EdgeMapWeighted(Graph& graph,
+  VertexSubset const& subset,
+  VertexProgram& f,
+  EdgeBalance balance = EdgeBalance::ALL_EDGES) noexcept
+{
+  ForEachBalancedRange(graph,
+    subset,
+    tbb::blocked_range<VertexLabel>{ 0, graph.max_v() + 1 },
+    balance,
+    [&](VertexLabel first, VertexLabel end) {
+      graph.EdgeMapWeighted(f, subset, ranges::iota_view{ first, end });
+    });
 }
 
 template<typename Graph, typename VertexFunction>
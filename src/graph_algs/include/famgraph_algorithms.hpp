@@ -2,9 +2,21 @@
 #define FAM_FAMGRAPH_ALGORITHMS_HPP
 
 #include <limits>
+#include <numeric>
 #include <atomic>
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <tbb/parallel_reduce.h>
+#include <tbb/parallel_sort.h>
 #include <famgraph.hpp>
 #include <NopSubstrate.hpp>
+#include <intersection.hpp>
+#include <hyperloglog.hpp>
 
 namespace famgraph {
 template<typename AdjacencyGraph, typename Substrate = NopSubstrate>
@@ -63,6 +75,320 @@ public:
   }
 };
 
+// Breadth first searches from up to Sources vertices at once. Each vertex
+// holds one bit per search in a few words: the searches that have seen it,
+// those whose frontier it is on, and those about to reach it. A vertex is
+// on the shared frontier while any search visits it, so every adjacency
+// list is read once per level for all searches together rather than once
+// per search.
+template<typename AdjacencyGraph, std::size_t Sources = 64>
+class MultiSourceBreadthFirstSearch
+{
+  static_assert(Sources % 64 == 0, "searches come in words of 64");
+  constexpr static std::size_t Words = Sources / 64;
+
+  struct Vertex
+  {
+    std::array<std::uint64_t, Words> seen;
+    std::array<std::uint64_t, Words> visit;
+    std::array<std::atomic<std::uint64_t>, Words> next;
+  };
+
+  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+
+public:
+  MultiSourceBreadthFirstSearch(AdjacencyGraph& graph) : graph_(graph) {}
+
+  struct SearchResult
+  {
+    VertexLabel reached;
+    std::uint32_t max_distance;// eccentricity of the source
+    std::uint64_t distance_sum;
+  };
+
+  struct Result
+  {
+    std::uint32_t levels;// largest eccentricity
+    std::vector<SearchResult> searches;// in the order of the sources
+  };
+
+  Result operator()(std::vector<VertexLabel> const& sources)
+  {
+    if (sources.size() > Sources)
+      throw std::runtime_error(
+        "MultiSourceBreadthFirstSearch: more sources than searches");
+
+    auto const max_v = this->graph_.max_v();
+    famgraph::VertexSubset frontierA{ max_v };
+    famgraph::VertexSubset frontierB{ max_v };
+
+    auto *frontier = &frontierA;
+    auto *next_frontier = &frontierB;
+
+    auto& graph = this->graph_;
+    auto& adj_graph = graph.getAdjacencyGraph();
+
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel) noexcept {
+      for (std::size_t k = 0; k < Words; ++k) {
+        vertex.seen[k] = 0;
+        vertex.visit[k] = 0;
+        vertex.next[k].store(0, std::memory_order_relaxed);
+      }
+    });
+
+    std::vector<SearchResult> searches(sources.size(), { 1, 0, 0 });
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+      auto const bit = std::uint64_t{ 1 } << (i % 64);
+      graph[sources[i]].seen[i / 64] |= bit;
+      graph[sources[i]].visit[i / 64] |= bit;
+      frontier->Set(sources[i]);
+    }
+
+    auto push = [&](uint32_t const v,
+                  uint32_t const w,
+                  uint64_t const /*v_degree*/) noexcept {
+      auto& from = graph[v];
+      auto& to = graph[w];
+      auto reached = false;
+      for (std::size_t k = 0; k < Words; ++k) {
+        auto const bits = from.visit[k] & ~to.seen[k];
+        if (bits == 0) continue;
+        to.next[k].fetch_or(bits, std::memory_order_relaxed);
+        reached = true;
+      }
+      if (reached) next_frontier->Set(w);
+    };
+
+    // Moves the searches about to reach each vertex onto it, and counts the
+    // vertices each search reached
+    using Counts = std::array<VertexLabel, Sources>;
+    auto advance = [&]() {
+      return tbb::parallel_reduce(
+        tbb::blocked_range<VertexLabel>{ 0, max_v + 1 },
+        Counts{},
+        [&](auto const& my_range, Counts counts) {
+          for (auto v = my_range.begin(); v < my_range.end(); ++v) {
+            auto& vertex = graph[v];
+            for (std::size_t k = 0; k < Words; ++k) {
+              auto const arriving =
+                vertex.next[k].exchange(0, std::memory_order_relaxed)
+                & ~vertex.seen[k];
+              vertex.seen[k] |= arriving;
+              vertex.visit[k] = arriving;
+              for (auto bits = arriving; bits != 0; bits &= bits - 1) {
+                ++counts[k * 64
+                         + static_cast<std::size_t>(__builtin_ctzll(bits))];
+              }
+            }
+          }
+          return counts;
+        },
+        [](Counts a, Counts const& b) {
+          for (std::size_t i = 0; i < Sources; ++i) a[i] += b[i];
+          return a;
+        });
+    };
+
+    std::uint32_t levels = 0;
+    while (!frontier->IsEmpty()) {
+      EdgeMap(adj_graph, *frontier, push);
+      frontier->Clear();
+      std::swap(frontier, next_frontier);
+      if (frontier->IsEmpty()) break;
+
+      ++levels;
+      auto const counts = advance();
+      for (std::size_t i = 0; i < searches.size(); ++i) {
+        if (counts[i] == 0) continue;
+        searches[i].reached += counts[i];
+        searches[i].max_distance = levels;
+        searches[i].distance_sum += std::uint64_t{ levels } * counts[i];
+      }
+    }
+    return { levels, searches };
+  }
+};
+
+// Betweenness centrality by Brandes' algorithm, Batch sources at a time.
+// The searches of a batch advance level by level together: a forward pass
+// counts shortest paths and keeps the frontier of every level, and a
+// backward pass over those frontiers, deepest first, accumulates each
+// vertex's dependency on its successors. Centralities sum over ordered
+// pairs of vertices, so they are twice the usual figure on symmetric
+// graphs.
+template<typename AdjacencyGraph, std::size_t Batch = 8>
+class BetweennessCentrality
+{
+  constexpr static auto UNSEEN = std::numeric_limits<std::uint32_t>::max();
+
+  struct Vertex
+  {
+    std::array<std::atomic<std::uint32_t>, Batch> depth;
+    std::array<std::atomic<double>, Batch> paths;
+    std::array<std::atomic<double>, Batch> dependency;
+    double centrality;
+  };
+
+  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+
+  static void AddAtomic(std::atomic<double>& x, double const y) noexcept
+  {
+    auto current = x.load(std::memory_order_relaxed);
+    while (!x.compare_exchange_weak(current,
+      current + y,
+      std::memory_order_relaxed,
+      std::memory_order_relaxed))
+      ;
+  }
+
+  // Adds the dependencies of up to Batch sources to the centralities
+  void RunBatch(VertexLabel const *sources, std::size_t n)
+  {
+    auto const max_v = this->graph_.max_v();
+    auto& graph = this->graph_;
+    auto& adj_graph = graph.getAdjacencyGraph();
+
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel) noexcept {
+      for (std::size_t k = 0; k < Batch; ++k) {
+        vertex.depth[k].store(UNSEEN, std::memory_order_relaxed);
+        vertex.paths[k].store(0, std::memory_order_relaxed);
+        vertex.dependency[k].store(0, std::memory_order_relaxed);
+      }
+    });
+
+    // levels[d]: vertices at depth d from any source of the batch
+    std::vector<std::unique_ptr<VertexSubset>> levels;
+    levels.push_back(std::make_unique<VertexSubset>(max_v));
+    for (std::size_t k = 0; k < n; ++k) {
+      graph[sources[k]].depth[k].store(0, std::memory_order_relaxed);
+      graph[sources[k]].paths[k].store(1, std::memory_order_relaxed);
+      levels.back()->Set(sources[k]);
+    }
+
+    std::uint32_t depth = 0;
+    VertexSubset *next_frontier = nullptr;
+    auto forward = [&](uint32_t const v,
+                     uint32_t const w,
+                     uint64_t const /*v_degree*/) noexcept {
+      auto& from = graph[v];
+      auto& to = graph[w];
+      for (std::size_t k = 0; k < n; ++k) {
+        if (from.depth[k].load(std::memory_order_relaxed) != depth) continue;
+        auto expect = UNSEEN;
+        if (to.depth[k].compare_exchange_strong(expect,
+              depth + 1,
+              std::memory_order_relaxed,
+              std::memory_order_relaxed)) {
+          next_frontier->Set(w);
+          expect = depth + 1;
+        }
+        if (expect == depth + 1)
+          AddAtomic(to.paths[k], from.paths[k].load(std::memory_order_relaxed));
+      }
+    };
+
+    while (true) {
+      auto next = std::make_unique<VertexSubset>(max_v);
+      next_frontier = next.get();
+      EdgeMap(adj_graph, *levels.back(), forward);
+      if (next->IsEmpty()) break;
+      levels.push_back(std::move(next));
+      ++depth;
+    }
+
+    // dependencies flow from depth + 1 back to depth
+    auto backward = [&](uint32_t const v,
+                      uint32_t const w,
+                      uint64_t const /*v_degree*/) noexcept {
+      auto& from = graph[v];
+      auto& to = graph[w];
+      for (std::size_t k = 0; k < n; ++k) {
+        if (from.depth[k].load(std::memory_order_relaxed) != depth
+            || to.depth[k].load(std::memory_order_relaxed) != depth + 1)
+          continue;
+        auto const share = from.paths[k].load(std::memory_order_relaxed)
+                           / to.paths[k].load(std::memory_order_relaxed);
+        AddAtomic(from.dependency[k],
+          share * (1 + to.dependency[k].load(std::memory_order_relaxed)));
+      }
+    };
+    while (depth > 0) {
+      --depth;
+      EdgeMap(adj_graph, *levels[depth], backward);
+    }
+
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+      for (std::size_t k = 0; k < n; ++k) {
+        if (v != sources[k])
+          vertex.centrality +=
+            vertex.dependency[k].load(std::memory_order_relaxed);
+      }
+    });
+  }
+
+public:
+  BetweennessCentrality(AdjacencyGraph& graph) : graph_(graph) {}
+
+  struct Result
+  {
+    std::uint32_t sources;
+    VertexLabel most_central;
+    double max_centrality;
+  };
+
+  // Exact centralities, from every vertex
+  Result operator()()
+  {
+    std::vector<VertexLabel> sources(this->graph_.NumVertices());
+    std::iota(sources.begin(), sources.end(), VertexLabel{ 0 });
+    return (*this)(sources);
+  }
+
+  // Dependencies on the given sources only
+  Result operator()(std::vector<VertexLabel> const& sources, double scale = 1)
+  {
+    famgraph::VertexMap(this->graph_, [&](Vertex& vertex, VertexLabel) {
+      vertex.centrality = 0;
+    });
+    for (std::size_t first = 0; first < sources.size(); first += Batch) {
+      this->RunBatch(
+        sources.data() + first, std::min(Batch, sources.size() - first));
+    }
+
+    Result result{ static_cast<std::uint32_t>(sources.size()), 0, 0 };
+    for (VertexLabel v = 0; v <= this->graph_.max_v(); ++v) {
+      auto& centrality = this->graph_[v].centrality;
+      centrality *= scale;
+      if (centrality > result.max_centrality)
+        result = { result.sources, v, centrality };
+    }
+    return result;
+  }
+
+  // Estimates from samples distinct random sources, scaled up to all of
+  // the graph's vertices
+  Result Sample(std::uint32_t samples, std::uint64_t seed)
+  {
+    auto const n = this->graph_.NumVertices();
+    samples = std::min(samples, n);
+    std::vector<VertexLabel> vertices(n);
+    std::iota(vertices.begin(), vertices.end(), VertexLabel{ 0 });
+    std::mt19937_64 gen{ seed };
+    for (std::uint32_t i = 0; i < samples; ++i) {
+      std::uniform_int_distribution<VertexLabel> pick{ i, n - 1 };
+      std::swap(vertices[i], vertices[pick(gen)]);
+    }
+    vertices.resize(samples);
+    return (*this)(vertices,
+      samples == 0 ? 0 : static_cast<double>(n) / samples);
+  }
+
+  double GetCentrality(VertexLabel v) noexcept
+  {
+    return this->graph_[v].centrality;
+  }
+};
+
 template<typename AdjacencyGraph> class KcoreDecomposition
 {
   using VertexDegreeClass = std::uint32_t;
@@ -75,11 +401,16 @@ template<typename AdjacencyGraph> class KcoreDecomposition
 
   VertexLabel KthCoreSize(VertexDegreeClass k) noexcept
   {
-    VertexLabel size = 0;
-    for (VertexLabel v = 0; v <= this->graph_.max_v(); ++v) {
-      if (this->graph_[v].degree >= k) ++size;
-    }
-    return size;
+    return tbb::parallel_reduce(
+      tbb::blocked_range<VertexLabel>{ 0, this->graph_.max_v() + 1 },
+      VertexLabel{ 0 },
+      [&](auto const& my_range, VertexLabel size) {
+        for (auto v = my_range.begin(); v < my_range.end(); ++v) {
+          if (this->graph_[v].degree >= k) ++size;
+        }
+        return size;
+      },
+      [](VertexLabel a, VertexLabel b) { return a + b; });
   }
 
 public:
@@ -125,6 +456,160 @@ public:
   }
 };
 
+struct ComponentsSummary
+{
+  VertexLabel components;
+  VertexLabel non_trivial_components;
+  VertexLabel largest_component_size;
+};
+
+// Counts the components of the labelling label_of(v) of [0, max_v]
+template<typename LabelFunction>
+ComponentsSummary SummarizeComponents(VertexLabel max_v,
+  LabelFunction const& label_of)
+{
+  std::unordered_map<VertexLabel, VertexLabel> comp_counts;
+  for (VertexLabel v = 0; v <= max_v; ++v) { comp_counts[label_of(v)]++; }
+
+  VertexLabel non_trivial = 0;
+  VertexLabel largest_component_size = 0;
+  for (auto const& [label, count] : comp_counts) {
+    if (count > 1) non_trivial++;
+    largest_component_size = std::max(largest_component_size, count);
+  }
+  return { static_cast<VertexLabel>(comp_counts.size()),
+    non_trivial,
+    largest_component_size };
+}
+
+// The coreness of every vertex of a symmetric graph in one run, by peeling
+// in increasing order of k as in Julienne. The bucket being peeled is the
+// frontier: its vertices get coreness k, and neighbours whose degree drops
+// to k join the next frontier of the same bucket. Degrees never drop below
+// the bucket being peeled. An empty bucket moves on to the least remaining
+// degree, so levels with no vertices cost nothing.
+template<typename AdjacencyGraph> class CoreDecomposition
+{
+  constexpr static auto UNPEELED = std::numeric_limits<std::uint32_t>::max();
+
+  struct Vertex
+  {
+    std::atomic<std::uint32_t> degree;
+    std::uint32_t coreness;
+  };
+
+  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+
+  // Least degree among the vertices not yet peeled, UNPEELED if none is left
+  std::uint32_t NextBucket() noexcept
+  {
+    return tbb::parallel_reduce(
+      tbb::blocked_range<VertexLabel>{ 0, this->graph_.max_v() + 1 },
+      UNPEELED,
+      [&](auto const& my_range, std::uint32_t least) {
+        for (auto v = my_range.begin(); v < my_range.end(); ++v) {
+          auto const& vertex = this->graph_[v];
+          if (vertex.coreness == UNPEELED)
+            least = std::min(
+              least, vertex.degree.load(std::memory_order_relaxed));
+        }
+        return least;
+      },
+      [](std::uint32_t a, std::uint32_t b) { return std::min(a, b); });
+  }
+
+  // core_sizes[k] is the number of vertices of coreness k or more
+  std::vector<VertexLabel> CoreSizes(std::uint32_t max_core) noexcept
+  {
+    using Histogram = std::vector<VertexLabel>;
+    auto sizes = tbb::parallel_reduce(
+      tbb::blocked_range<VertexLabel>{ 0, this->graph_.max_v() + 1 },
+      Histogram(std::size_t{ max_core } + 1),
+      [&](auto const& my_range, Histogram histogram) {
+        for (auto v = my_range.begin(); v < my_range.end(); ++v) {
+          ++histogram[this->graph_[v].coreness];
+        }
+        return histogram;
+      },
+      [](Histogram a, Histogram const& b) {
+        for (std::size_t k = 0; k < a.size(); ++k) a[k] += b[k];
+        return a;
+      });
+    std::partial_sum(sizes.rbegin(), sizes.rend(), sizes.rbegin());
+    return sizes;
+  }
+
+public:
+  CoreDecomposition(AdjacencyGraph& graph) : graph_(graph) {}
+
+  struct Result
+  {
+    std::uint32_t max_core;
+    std::vector<VertexLabel> core_sizes;
+  };
+
+  Result operator()()
+  {
+    auto const max_v = this->graph_.max_v();
+    famgraph::VertexSubset frontierA{ max_v };
+    famgraph::VertexSubset frontierB{ max_v };
+
+    auto *frontier = &frontierA;
+    auto *next_frontier = &frontierB;
+
+    auto& graph = this->graph_;
+    auto& adj_graph = graph.getAdjacencyGraph();
+
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+      auto const d = static_cast<std::uint32_t>(adj_graph.Degree(v));
+      vertex.degree.store(d, std::memory_order_relaxed);
+      vertex.coreness = UNPEELED;
+    });
+
+    std::uint32_t k = 0;
+    auto peel = [&](uint32_t const,
+                  uint32_t const w,
+                  uint64_t const /*v_degree*/) noexcept {
+      auto& degree = graph[w].degree;
+      auto d = degree.load(std::memory_order_relaxed);
+      while (d > k) {
+        if (degree.compare_exchange_weak(
+              d, d - 1, std::memory_order_relaxed, std::memory_order_relaxed)) {
+          if (d - 1 == k) next_frontier->Set(w);
+          return;
+        }
+      }
+    };
+
+    std::uint32_t max_core = 0;
+    while (true) {
+      k = this->NextBucket();
+      if (k == UNPEELED) break;
+      max_core = k;
+      famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+        if (vertex.coreness == UNPEELED
+            && vertex.degree.load(std::memory_order_relaxed) == k)
+          frontier->Set(v);
+      });
+      while (!frontier->IsEmpty()) {
+        famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+          if ((*frontier)[v]) vertex.coreness = k;
+        });
+        EdgeMap(adj_graph, *frontier, peel);
+        frontier->Clear();
+        std::swap(frontier, next_frontier);
+      }
+    }
+
+    return { max_core, this->CoreSizes(max_core) };
+  }
+
+  std::uint32_t GetCoreness(VertexLabel v) noexcept
+  {
+    return this->graph_[v].coreness;
+  }
+};
+
 template<typename AdjacencyGraph, typename Substrate = NopSubstrate>
 class ConnectedComponents
 {
@@ -156,12 +641,7 @@ class ConnectedComponents
 public:
   ConnectedComponents(AdjacencyGraph& graph) : graph_(graph) {}
 
-  struct Result
-  {
-    VertexLabel components;
-    VertexLabel non_trivial_components;
-    VertexLabel largest_component_size;
-  };
+  using Result = ComponentsSummary;
 
   Result operator()()
   {
@@ -197,100 +677,1145 @@ public:
       Substrate::SyncFrontier(*frontier);
     }
 
-    return this->Components();
-  }
-
-private:
-  Result Components() noexcept
-  {
-    std::unordered_map<VertexLabel, VertexLabel> comp_counts;
-    for (VertexLabel v = 0; v <= this->graph_.max_v(); ++v) {
-      auto const label = this->graph_[v].label.load(std::memory_order_relaxed);
-      if (comp_counts.find(label) == comp_counts.end())
-        comp_counts.insert(std::make_pair(label, 1));
-      else
-        comp_counts[label]++;
-    }
-
-    std::vector<std::pair<VertexLabel, VertexLabel>> v;
-    for (auto p : comp_counts) {
-      v.push_back(std::make_pair(p.second, p.first));
-    }
-    std::sort(v.begin(), v.end());
-
-    VertexLabel trivial_comps = 0;
-    VertexLabel non_trivial = 0;
-    for (auto it = v.rbegin(); it != v.rend(); ++it) {
-      const uint32_t count = it->first;
-      if (count > 1) {
-        non_trivial++;
-      } else {
-        trivial_comps++;
-      }
-    }
-
-    auto const largest_component_size = v.rbegin()->first;
-    return { trivial_comps + non_trivial, non_trivial, largest_component_size };
+    return SummarizeComponents(max_v, [&](VertexLabel v) {
+      return graph[v].label.load(std::memory_order_relaxed);
+    });
   }
 };
 
-template<typename AdjacencyGraph> class PageRank
+// Connected components of a symmetric graph by union-find, after Afforest
+// (Sutton et al.). Every vertex is first hooked to a few of its neighbours,
+// which is usually enough to assemble most of the largest component. Only
+// the vertices found outside of it then have all of their edges linked, so
+// every adjacency list is read at most twice, whatever the diameter.
+//
+// On a directed graph an edge can only be linked from its tail, so nothing
+// may be skipped: with symmetric = false every edge is linked in a single
+// pass, which yields the weakly connected components.
+template<typename AdjacencyGraph> class Afforest
 {
-  static constexpr float alpha = 0.85f;
-  static constexpr float epsilon = 0.001f;
-  static constexpr float INIT_RESIDUAL = 1 - alpha;
-
   struct Vertex
   {
-    float value;
-    float delta;
-    std::atomic<float> residual;
+    std::atomic<VertexLabel> parent;
+    std::atomic<std::uint32_t> sampled;// edges linked by the sampling pass
+  };
 
-    bool update_add_atomic(float const s_val) noexcept
-    {
-      auto current = residual.load(std::memory_order_relaxed);
-      while (!residual.compare_exchange_weak(current,
-        current + s_val,
-        std::memory_order_relaxed,
-        std::memory_order_relaxed))
-        ;
-      return true;
+  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+  std::uint32_t const neighbor_rounds_;
+  bool const symmetric_;
+
+  // Hooks the larger of the two roots under the smaller one
+  void Link(VertexLabel u, VertexLabel v) noexcept
+  {
+    auto& graph = this->graph_;
+    auto p1 = graph[u].parent.load(std::memory_order_relaxed);
+    auto p2 = graph[v].parent.load(std::memory_order_relaxed);
+    while (p1 != p2) {
+      auto high = std::max(p1, p2);
+      auto const low = std::min(p1, p2);
+      auto const p_high = graph[high].parent.load(std::memory_order_relaxed);
+      if (p_high == low) break;
+      if (p_high == high
+          && graph[high].parent.compare_exchange_strong(
+            high, low, std::memory_order_relaxed, std::memory_order_relaxed))
+        break;
+      p1 = graph[graph[high].parent.load(std::memory_order_relaxed)]
+             .parent.load(std::memory_order_relaxed);
+      p2 = graph[low].parent.load(std::memory_order_relaxed);
     }
+  }
 
-    bool vertex_map() noexcept
-    {
-      auto res = residual.load(std::memory_order_relaxed);
-      if (std::abs(res) > epsilon) {
-        value += res;
-        delta = res;// load up
-        residual.store(0, std::memory_order_relaxed);// clear
-        return true;
-      } else {
-        return false;
+  // Points every vertex straight at its root
+  void Compress() noexcept
+  {
+    auto& graph = this->graph_;
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel) noexcept {
+      auto p = vertex.parent.load(std::memory_order_relaxed);
+      while (true) {
+        auto const pp = graph[p].parent.load(std::memory_order_relaxed);
+        if (pp == p) break;
+        p = pp;
       }
-    }
-  };
+      vertex.parent.store(p, std::memory_order_relaxed);
+    });
+  }
 
-  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+  // The most frequent root among samples random vertices
+  VertexLabel SampleLargestComponent(std::uint32_t samples) noexcept
+  {
+    std::mt19937 gen{ 27491095 };
+    std::uniform_int_distribution<VertexLabel> pick{ 0, this->graph_.max_v() };
+    std::unordered_map<VertexLabel, std::uint32_t> counts;
+    for (std::uint32_t i = 0; i < samples; ++i) {
+      ++counts[this->graph_[pick(gen)].parent.load(std::memory_order_relaxed)];
+    }
+    return std::max_element(counts.begin(),
+      counts.end(),
+      [](auto const& a, auto const& b) { return a.second < b.second; })
+      ->first;
+  }
 
 public:
-  PageRank(AdjacencyGraph& graph) : graph_(graph) {}
+  Afforest(AdjacencyGraph& graph,
+    std::uint32_t neighbor_rounds = 2,
+    bool symmetric = true)
+    : graph_(graph), neighbor_rounds_(neighbor_rounds), symmetric_(symmetric)
+  {}
 
-  struct Result
-  {
-    int iterations;
-    std::vector<std::pair<float, VertexLabel>> topN;
-  };
+  using Result = ComponentsSummary;
 
   Result operator()()
   {
     auto const max_v = this->graph_.max_v();
-    famgraph::VertexSubset frontierA{ max_v };
-    famgraph::VertexSubset frontierB{ max_v };
-
-    auto *frontier = &frontierA;
-    auto *next_frontier = &frontierB;
-
+    auto& graph = this->graph_;
+    auto& adj_graph = graph.getAdjacencyGraph();
+
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+      vertex.parent.store(v, std::memory_order_relaxed);
+      vertex.sampled.store(0, std::memory_order_relaxed);
+    });
+
+    auto sample = [&](uint32_t const v,
+                    uint32_t const w,
+                    uint64_t const /*v_degree*/) noexcept {
+      auto& sampled = graph[v].sampled;
+      if (sampled.load(std::memory_order_relaxed) >= this->neighbor_rounds_)
+        return;
+      if (sampled.fetch_add(1, std::memory_order_relaxed)
+          < this->neighbor_rounds_)
+        this->Link(v, w);
+    };
+    famgraph::VertexSubset subset{ max_v };
+    subset.SetAll();
+    if (this->symmetric_) {
+      EdgeMap(adj_graph, subset, sample);
+      this->Compress();
+
+      // vertices of the largest component have nothing left to link: any
+      // edge leaving it is linked from its other end
+      auto const largest = this->SampleLargestComponent(1024);
+      subset.Clear();
+      famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+        if (vertex.parent.load(std::memory_order_relaxed) != largest)
+          subset.Set(v);
+      });
+    }
+    auto link = [&](uint32_t const v,
+                  uint32_t const w,
+                  uint64_t const /*v_degree*/) noexcept { this->Link(v, w); };
+    EdgeMap(adj_graph, subset, link);
+    this->Compress();
+
+    return SummarizeComponents(max_v, [&](VertexLabel v) {
+      return graph[v].parent.load(std::memory_order_relaxed);
+    });
+  }
+
+  VertexLabel GetComponent(VertexLabel v) noexcept
+  {
+    return this->graph_[v].parent.load(std::memory_order_relaxed);
+  }
+};
+
+// Strongly connected components of a directed graph, given with its
+// transpose, in the manner of Multistep (Slota et al.):
+//  1. trim: vertices without in- or out-edges are components of their own
+//  2. forward-backward: the vertices both reachable from and reaching a
+//     pivot of high degree, usually the giant component
+//  3. coloring, until every vertex is assigned: the largest label among
+//     the unassigned vertices that reach each vertex is propagated
+//     forwards; a vertex that keeps its own label roots a component, found
+//     by a backward search over vertices of its colour
+// Forward steps EdgeMap the graph and backward steps the transpose, only
+// ever from unassigned vertices. Components are labelled by their pivot or
+// root. Weak components need no transpose, see Afforest.
+template<typename AdjacencyGraph, typename TransposedGraph = AdjacencyGraph>
+class StronglyConnectedComponents
+{
+  struct Vertex
+  {
+    std::atomic<VertexLabel> component;
+    std::atomic<VertexLabel> color;
+  };
+
+  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+  TransposedGraph& transposed_;
+
+  bool Unassigned(VertexLabel v) noexcept
+  {
+    return this->graph_[v].component.load(std::memory_order_relaxed)
+           == null_vert;
+  }
+
+  // Breadth first search over adjacency graph g from frontier, entering
+  // the vertices w with enter(v, w) true
+  template<typename G, typename Enter>
+  void Search(G& g, VertexSubset& frontier, Enter const& enter)
+  {
+    auto const max_v = this->graph_.max_v();
+    famgraph::VertexSubset next{ max_v };
+    auto *current = &frontier;
+    auto *next_frontier = &next;
+    auto push = [&](uint32_t const v,
+                  uint32_t const w,
+                  uint64_t const /*v_degree*/) noexcept {
+      if (enter(v, w)) next_frontier->Set(w);
+    };
+    while (!current->IsEmpty()) {
+      EdgeMap(g, *current, push);
+      current->Clear();
+      std::swap(current, next_frontier);
+    }
+  }
+
+  // The unassigned vertex with the most paths through it, roughly
+  VertexLabel Pivot() noexcept
+  {
+    using Candidate = std::pair<EdgeIndexType, VertexLabel>;
+    auto& adj_graph = this->graph_.getAdjacencyGraph();
+    return tbb::parallel_reduce(
+      tbb::blocked_range<VertexLabel>{ 0, this->graph_.max_v() + 1 },
+      Candidate{ 0, null_vert },
+      [&](auto const& my_range, Candidate best) {
+        for (auto v = my_range.begin(); v < my_range.end(); ++v) {
+          if (!this->Unassigned(v)) continue;
+          auto const paths =
+            adj_graph.Degree(v) * this->transposed_.Degree(v);
+          if (best.second == null_vert || paths > best.first)
+            best = { paths, v };
+        }
+        return best;
+      },
+      [](Candidate a, Candidate b) {
+        if (a.second == null_vert) return b;
+        if (b.second == null_vert) return a;
+        return a.first >= b.first ? a : b;
+      })
+      .second;
+  }
+
+  void Trim()
+  {
+    auto& adj_graph = this->graph_.getAdjacencyGraph();
+    famgraph::VertexMap(
+      this->graph_, [&](Vertex& vertex, VertexLabel v) noexcept {
+        if (adj_graph.Degree(v) == 0 || this->transposed_.Degree(v) == 0)
+          vertex.component.store(v, std::memory_order_relaxed);
+      });
+  }
+
+  void ForwardBackward(VertexLabel pivot)
+  {
+    auto const max_v = this->graph_.max_v();
+    auto& graph = this->graph_;
+    famgraph::VertexSubset reached{ max_v };
+    famgraph::VertexSubset frontier{ max_v };
+    reached.Set(pivot);
+    frontier.Set(pivot);
+    this->Search(graph.getAdjacencyGraph(),
+      frontier,
+      [&](VertexLabel, VertexLabel w) {
+        return this->Unassigned(w) && reached.Set(w);
+      });
+
+    graph[pivot].component.store(pivot, std::memory_order_relaxed);
+    frontier.Set(pivot);
+    this->Search(
+      this->transposed_, frontier, [&](VertexLabel, VertexLabel w) {
+        auto expect = null_vert;
+        return reached[w]
+               && graph[w].component.compare_exchange_strong(expect,
+                 pivot,
+                 std::memory_order_relaxed,
+                 std::memory_order_relaxed);
+      });
+  }
+
+  void Color()
+  {
+    auto const max_v = this->graph_.max_v();
+    auto& graph = this->graph_;
+    famgraph::VertexSubset frontier{ max_v };
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+      if (!this->Unassigned(v)) return;
+      vertex.color.store(v, std::memory_order_relaxed);
+      frontier.Set(v);
+    });
+
+    this->Search(graph.getAdjacencyGraph(),
+      frontier,
+      [&](VertexLabel v, VertexLabel w) {
+        if (!this->Unassigned(w)) return false;
+        auto const color = graph[v].color.load(std::memory_order_relaxed);
+        auto& w_color = graph[w].color;
+        auto current = w_color.load(std::memory_order_relaxed);
+        while (color > current) {
+          if (w_color.compare_exchange_weak(current,
+                color,
+                std::memory_order_relaxed,
+                std::memory_order_relaxed))
+            return true;
+        }
+        return false;
+      });
+
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+      if (this->Unassigned(v)
+          && vertex.color.load(std::memory_order_relaxed) == v)
+        frontier.Set(v);
+    });
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+      if (frontier[v]) vertex.component.store(v, std::memory_order_relaxed);
+    });
+    this->Search(
+      this->transposed_, frontier, [&](VertexLabel v, VertexLabel w) {
+        auto const color = graph[v].color.load(std::memory_order_relaxed);
+        auto expect = null_vert;
+        return graph[w].color.load(std::memory_order_relaxed) == color
+               && graph[w].component.compare_exchange_strong(expect,
+                 color,
+                 std::memory_order_relaxed,
+                 std::memory_order_relaxed);
+      });
+  }
+
+public:
+  StronglyConnectedComponents(AdjacencyGraph& graph,
+    TransposedGraph& transposed)
+    : graph_(graph), transposed_(transposed)
+  {}
+
+  using Result = ComponentsSummary;
+
+  Result operator()()
+  {
+    auto& graph = this->graph_;
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel) noexcept {
+      vertex.component.store(null_vert, std::memory_order_relaxed);
+    });
+
+    this->Trim();
+    auto const pivot = this->Pivot();
+    if (pivot != null_vert) this->ForwardBackward(pivot);
+    while (this->Pivot() != null_vert) this->Color();
+
+    return SummarizeComponents(graph.max_v(), [&](VertexLabel v) {
+      return graph[v].component.load(std::memory_order_relaxed);
+    });
+  }
+
+  VertexLabel GetComponent(VertexLabel v) noexcept
+  {
+    return this->graph_[v].component.load(std::memory_order_relaxed);
+  }
+};
+
+// The splitmix64 finalizer, for random numbers that do not depend on the
+// schedule
+inline std::uint64_t Mix64(std::uint64_t x) noexcept
+{
+  x += 0x9e3779b97f4a7c15;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+struct LabelPropagationOptions
+{
+  int max_iterations = 20;
+  // Synchronous rounds with ties going to the least label, so that the
+  // result does not depend on the schedule. Otherwise labels are updated
+  // in place as soon as they are voted and ties are broken by a hash.
+  bool deterministic = false;
+  std::uint64_t seed = 0;
+};
+
+// Community detection on a symmetric graph by label propagation (Raghavan
+// et al.). Every vertex starts in a community of its own and repeatedly
+// takes the most frequent label among itself and its neighbours; its own
+// vote damps the oscillations of synchronous rounds. A vertex only votes
+// again once a neighbour has changed label, so late rounds touch the few
+// vertices still moving.
+//
+// A thread collects the labels of each run of consecutive edges of one
+// vertex, and sorts them to count the votes. A run of the whole list votes
+// at once; the runs of a list split across tasks are merged afterwards.
+// Every thread keeps its buffers from run to run and round to round, so
+// they only grow for a longer list than the thread has met so far.
+template<typename AdjacencyGraph> class LabelPropagation
+{
+  struct Vertex
+  {
+    std::atomic<VertexLabel> label;
+    VertexLabel next;
+  };
+
+  struct Run
+  {
+    VertexLabel v = null_vert;
+    EdgeIndexType degree = 0;
+    std::vector<VertexLabel> labels;
+    // (vertex, label) of the runs short of a whole list
+    std::vector<std::pair<VertexLabel, VertexLabel>> split;
+  };
+
+  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+  LabelPropagationOptions const options_;
+  int round_ = 0;
+  tbb::enumerable_thread_specific<Run> runs_;
+
+  // The winner of the sorted votes [first, last) of v
+  VertexLabel Vote(VertexLabel v,
+    VertexLabel const *first,
+    VertexLabel const *last) const noexcept
+  {
+    auto const salt =
+      Mix64(this->options_.seed
+            ^ Mix64(static_cast<std::uint64_t>(this->round_) << 32 | v));
+    VertexLabel best = null_vert;
+    std::uint64_t best_count = 0;
+    std::uint64_t best_key = 0;
+    while (first != last) {
+      auto const label = *first;
+      auto const end = std::find_if(
+        first, last, [label](VertexLabel l) { return l != label; });
+      auto const count = static_cast<std::uint64_t>(end - first);
+      auto const key =
+        this->options_.deterministic ? label : Mix64(salt ^ label);
+      if (count > best_count || (count == best_count && key < best_key)) {
+        best = label;
+        best_count = count;
+        best_key = key;
+      }
+      first = end;
+    }
+    return best;
+  }
+
+  void Decide(VertexLabel v, VertexLabel label, VertexSubset& changed) noexcept
+  {
+    auto& vertex = this->graph_[v];
+    if (label == vertex.label.load(std::memory_order_relaxed)) return;
+    if (this->options_.deterministic)
+      vertex.next = label;
+    else
+      vertex.label.store(label, std::memory_order_relaxed);
+    changed.Set(v);
+  }
+
+  void Round(VertexSubset& frontier, VertexSubset& changed)
+  {
+    auto& graph = this->graph_;
+    auto flush = [&](Run& run) noexcept {
+      if (run.labels.empty()) return;
+      if (run.labels.size() == run.degree) {
+        run.labels.push_back(
+          graph[run.v].label.load(std::memory_order_relaxed));
+        std::sort(run.labels.begin(), run.labels.end());
+        auto const *first = run.labels.data();
+        this->Decide(run.v,
+          this->Vote(run.v, first, first + run.labels.size()),
+          changed);
+      } else {
+        for (auto const label : run.labels)
+          run.split.emplace_back(run.v, label);
+      }
+      run.labels.clear();
+    };
+    auto vote = [&](uint32_t const v,
+                  uint32_t const w,
+                  uint64_t const v_degree) noexcept {
+      auto& run = this->runs_.local();
+      if (run.v != v) {
+        flush(run);
+        run.v = v;
+        run.degree = v_degree;
+        // room for the whole list and v's own vote
+        run.labels.reserve(v_degree + 1);
+      }
+      run.labels.push_back(graph[w].label.load(std::memory_order_relaxed));
+    };
+    EdgeMap(graph.getAdjacencyGraph(), frontier, vote);
+
+    std::vector<std::pair<VertexLabel, VertexLabel>> split;
+    for (auto& run : this->runs_) {
+      flush(run);
+      split.insert(split.end(), run.split.begin(), run.split.end());
+      run.split.clear();
+      run.v = null_vert;
+    }
+    std::sort(split.begin(), split.end());
+    std::vector<VertexLabel> labels;
+    for (std::size_t i = 0; i < split.size();) {
+      auto const v = split[i].first;
+      labels.assign(1, graph[v].label.load(std::memory_order_relaxed));
+      for (; i < split.size() && split[i].first == v; ++i)
+        labels.push_back(split[i].second);
+      std::sort(labels.begin(), labels.end());
+      this->Decide(v,
+        this->Vote(v, labels.data(), labels.data() + labels.size()),
+        changed);
+    }
+  }
+
+public:
+  LabelPropagation(AdjacencyGraph& graph, LabelPropagationOptions options = {})
+    : graph_(graph), options_(options)
+  {}
+
+  struct Result
+  {
+    int iterations;
+    ComponentsSummary communities;
+  };
+
+  Result operator()()
+  {
+    auto const max_v = this->graph_.max_v();
+    famgraph::VertexSubset frontierA{ max_v };
+    famgraph::VertexSubset frontierB{ max_v };
+    famgraph::VertexSubset changed{ max_v };
+    auto *frontier = &frontierA;
+    auto *next_frontier = &frontierB;
+
+    auto& graph = this->graph_;
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+      vertex.label.store(v, std::memory_order_relaxed);
+    });
+    frontier->SetAll();
+
+    auto activate = [&](uint32_t const /*v*/,
+                      uint32_t const w,
+                      uint64_t const /*v_degree*/) noexcept {
+      next_frontier->Set(w);
+    };
+
+    int iterations = 0;
+    while (!frontier->IsEmpty()
+           && iterations < this->options_.max_iterations) {
+      this->round_ = iterations;
+      this->Round(*frontier, changed);
+      if (this->options_.deterministic) {
+        famgraph::VertexMap(
+          graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+            if (changed[v])
+              vertex.label.store(vertex.next, std::memory_order_relaxed);
+          });
+      }
+      EdgeMap(graph.getAdjacencyGraph(), changed, activate);
+      changed.Clear();
+      frontier->Clear();
+      std::swap(frontier, next_frontier);
+      ++iterations;
+    }
+
+    return { iterations, SummarizeComponents(max_v, [&](VertexLabel v) {
+              return graph[v].label.load(std::memory_order_relaxed);
+            }) };
+  }
+
+  VertexLabel GetLabel(VertexLabel v) noexcept
+  {
+    return this->graph_[v].label.load(std::memory_order_relaxed);
+  }
+};
+
+struct RandomWalkOptions
+{
+  std::uint32_t walk_length = 80;
+  std::uint32_t walks_per_vertex = 10;
+  // Walkers advanced together; a batch holds all of their walks
+  std::uint64_t batch_walkers = std::uint64_t{ 1 } << 20;
+  std::uint64_t seed = 0;
+};
+
+// Uniform random walks, as in DeepWalk, walks_per_vertex from every vertex.
+// The walkers of a batch move in lock-step: every round they are sorted by
+// the vertex they are on, and one EdgeMap over the occupied vertices reads
+// each list once for all of its walkers. A walker draws the position of its
+// next edge beforehand; the edges of a list are numbered as they are met,
+// in whatever order the tasks run, which leaves each draw uniform.
+//
+// A walk is walk_length labels, padded with null_vert after a vertex with
+// no out-edges. Walk k starts at vertex k % (max_v + 1).
+template<typename AdjacencyGraph> class RandomWalks
+{
+  struct Vertex
+  {
+    std::atomic<EdgeIndexType> position;// of the next edge met
+    std::uint64_t first;// walkers [first, last) of steps_
+    std::uint64_t last;
+  };
+
+  struct Step
+  {
+    VertexLabel v;
+    EdgeIndexType position;
+    std::uint64_t walker;// in the batch
+  };
+
+  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+  RandomWalkOptions const options_;
+  std::vector<Step> steps_;
+
+  // Takes step s of walkers [first, first + count); returns the walkers
+  // still moving
+  std::uint64_t Advance(std::vector<VertexLabel>& walks,
+    std::uint64_t first,
+    std::uint64_t count,
+    std::uint32_t s,
+    VertexSubset& occupied)
+  {
+    auto& graph = this->graph_;
+    auto& adj_graph = graph.getAdjacencyGraph();
+    auto& steps = this->steps_;
+    auto const length = this->options_.walk_length;
+    steps.resize(count);
+    tbb::parallel_for(std::uint64_t{ 0 }, count, [&](std::uint64_t i) {
+      auto const v = walks[i * length + s - 1];
+      auto const degree = v == null_vert ? 0 : adj_graph.Degree(v);
+      if (degree == 0) {
+        walks[i * length + s] = null_vert;
+        steps[i] = { null_vert, 0, i };
+        return;
+      }
+      auto const walker = first + i;
+      auto const draw = Mix64(this->options_.seed ^ (Mix64(walker) + s));
+      steps[i] = { v, draw % degree, i };
+    });
+    tbb::parallel_sort(
+      steps.begin(), steps.end(), [](Step const& a, Step const& b) {
+        return a.v < b.v || (a.v == b.v && a.position < b.position);
+      });
+
+    auto const moving = static_cast<std::uint64_t>(
+      std::lower_bound(steps.begin(),
+        steps.end(),
+        null_vert,
+        [](Step const& step, VertexLabel v) { return step.v < v; })
+      - steps.begin());
+    tbb::parallel_for(std::uint64_t{ 0 }, moving, [&](std::uint64_t i) {
+      auto const v = steps[i].v;
+      auto& vertex = graph[v];
+      if (i == 0 || steps[i - 1].v != v) {
+        vertex.position.store(0, std::memory_order_relaxed);
+        vertex.first = i;
+        occupied.Set(v);
+      }
+      if (i + 1 == moving || steps[i + 1].v != v) vertex.last = i + 1;
+    });
+
+    auto move = [&](uint32_t const v,
+                  uint32_t const w,
+                  uint64_t const /*v_degree*/) noexcept {
+      auto& vertex = graph[v];
+      auto const position =
+        vertex.position.fetch_add(1, std::memory_order_relaxed);
+      auto const *begin = steps.data() + vertex.first;
+      auto const *end = steps.data() + vertex.last;
+      auto const *it = std::lower_bound(begin,
+        end,
+        position,
+        [](Step const& step, EdgeIndexType p) { return step.position < p; });
+      for (; it != end && it->position == position; ++it)
+        walks[it->walker * length + s] = w;
+    };
+    EdgeMap(adj_graph, occupied, move);
+    occupied.Clear();
+    return moving;
+  }
+
+public:
+  RandomWalks(AdjacencyGraph& graph, RandomWalkOptions options = {})
+    : graph_(graph), options_(options)
+  {}
+
+  struct Result
+  {
+    std::uint64_t walks;
+    std::uint64_t steps;// edges walked
+  };
+
+  // Calls sink(walks, count) with the walks of every batch in order, count
+  // rows of walk_length labels
+  template<typename Sink> Result operator()(Sink&& sink)
+  {
+    auto const max_v = this->graph_.max_v();
+    auto const length = this->options_.walk_length;
+    auto const total =
+      (std::uint64_t{ max_v } + 1) * this->options_.walks_per_vertex;
+    auto const batch = std::max<std::uint64_t>(1, this->options_.batch_walkers);
+    famgraph::VertexSubset occupied{ max_v };
+    std::vector<VertexLabel> walks;
+    Result result{ total, 0 };
+    if (length == 0) return result;
+
+    for (std::uint64_t first = 0; first < total; first += batch) {
+      auto const count = std::min(batch, total - first);
+      walks.resize(count * length);
+      tbb::parallel_for(std::uint64_t{ 0 }, count, [&](std::uint64_t i) {
+        walks[i * length] =
+          static_cast<VertexLabel>((first + i) % (std::uint64_t{ max_v } + 1));
+      });
+      for (std::uint32_t s = 1; s < length; ++s)
+        result.steps += this->Advance(walks, first, count, s, occupied);
+      sink(static_cast<VertexLabel const *>(walks.data()), count);
+    }
+    return result;
+  }
+
+  // Streams the walks to walk_file, as rows of walk_length 32-bit labels
+  Result Write(std::string const& walk_file)
+  {
+    std::ofstream out{ walk_file, std::ios::binary };
+    if (!out) throw std::runtime_error("RandomWalks: cannot open " + walk_file);
+    auto const row_bytes = this->options_.walk_length * sizeof(VertexLabel);
+    auto const result = (*this)([&](VertexLabel const *walks,
+                                  std::uint64_t count) {
+      out.write(reinterpret_cast<char const *>(walks),
+        static_cast<std::streamsize>(count * row_bytes));
+    });
+    if (!out)
+      throw std::runtime_error("RandomWalks: cannot write " + walk_file);
+    return result;
+  }
+};
+
+struct NeighborSamplingOptions
+{
+  // Neighbours drawn per vertex at each hop
+  std::vector<std::uint32_t> fanouts{ 10, 10 };
+  bool replace = false;
+  std::uint64_t seed = 0;
+};
+
+// A sampled subgraph in local ids, which index vertices
+struct SampledSubgraph
+{
+  // Seeds first, then the vertices first reached at each hop
+  std::vector<VertexLabel> vertices;
+  // vertices[hop_vertices[h], hop_vertices[h + 1]) are reached at hop h,
+  // the seeds at hop 0
+  std::vector<std::size_t> hop_vertices;
+  // Edges sources[i] -> targets[i], those sampled from the vertices of hop
+  // h in [hop_edges[h], hop_edges[h + 1])
+  std::vector<VertexLabel> sources;
+  std::vector<VertexLabel> targets;
+  std::vector<std::size_t> hop_edges;
+};
+
+// Multi-hop neighbour sampling for minibatches of GNN training, as in
+// GraphSAGE. Each hop samples the out-neighbours of the vertices first
+// reached at the hop before, with one EdgeMap over all of them, so that a
+// remote graph reads their lists in as few batches as it can.
+//
+// Degrees are known from the index, so the positions to keep are drawn
+// before the lists arrive, as a uniform subset or with replacement. Edges
+// are numbered as they are decoded, in whatever order the tasks run, and
+// the ones at drawn positions are kept; a hub's list may be split.
+template<typename AdjacencyGraph> class NeighborSampler
+{
+  struct Vertex
+  {
+    std::atomic<EdgeIndexType> position;// of the next edge met
+    std::uint64_t first;// draws [first, last) of draws_
+    std::uint64_t last;
+    VertexLabel local;// in the sample being built
+  };
+
+  struct Draw
+  {
+    EdgeIndexType position;
+    VertexLabel target;
+  };
+
+  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+  NeighborSamplingOptions const options_;
+  famgraph::VertexSubset frontier_;
+  std::vector<Draw> draws_;
+  std::uint64_t batch_ = 0;
+
+  // Draws the positions kept of each list of vertices [begin, end)
+  void DrawPositions(std::vector<VertexLabel> const& vertices,
+    std::size_t begin,
+    std::size_t end,
+    std::uint32_t hop)
+  {
+    auto& graph = this->graph_;
+    auto& adj_graph = graph.getAdjacencyGraph();
+    auto const fanout = this->options_.fanouts[hop];
+    auto const replace = this->options_.replace;
+    auto const count = [&](VertexLabel v) -> EdgeIndexType {
+      auto const degree = adj_graph.Degree(v);
+      if (degree == 0) return 0;
+      return replace ? fanout : std::min<EdgeIndexType>(fanout, degree);
+    };
+
+    std::uint64_t total = 0;
+    for (auto i = begin; i < end; ++i) {
+      auto& vertex = graph[vertices[i]];
+      vertex.first = total;
+      total += count(vertices[i]);
+      vertex.last = total;
+    }
+    this->draws_.resize(total);
+
+    auto const salt = Mix64(this->options_.seed ^ Mix64(this->batch_));
+    tbb::parallel_for(begin, end, [&](std::size_t i) {
+      auto const v = vertices[i];
+      auto& vertex = graph[v];
+      vertex.position.store(0, std::memory_order_relaxed);
+      auto const degree = adj_graph.Degree(v);
+      auto *draws = this->draws_.data() + vertex.first;
+      auto const k = vertex.last - vertex.first;
+      auto const state = Mix64(salt ^ (std::uint64_t{ hop } << 32 | v));
+      auto const random = [state](std::uint64_t j, std::uint64_t n) {
+        return Mix64(state + j) % n;
+      };
+      if (replace) {
+        for (std::uint64_t j = 0; j < k; ++j)
+          draws[j].position = random(j, degree);
+      } else if (k == degree) {
+        for (std::uint64_t j = 0; j < k; ++j) draws[j].position = j;
+      } else {
+        // Floyd's algorithm: a uniform k-subset of [0, degree)
+        for (std::uint64_t j = 0; j < k; ++j) {
+          auto const top = degree - k + j;
+          auto const t = random(j, top + 1);
+          auto const taken = std::any_of(draws,
+            draws + j,
+            [t](Draw const& draw) { return draw.position == t; });
+          draws[j].position = taken ? top : t;
+        }
+      }
+      std::sort(draws, draws + k, [](Draw const& a, Draw const& b) {
+        return a.position < b.position;
+      });
+      this->frontier_.Set(v);
+    });
+  }
+
+public:
+  NeighborSampler(AdjacencyGraph& graph, NeighborSamplingOptions options = {})
+    : graph_(graph), options_(std::move(options)),
+      frontier_(graph_.max_v())
+  {
+    famgraph::VertexMap(
+      this->graph_, [](Vertex& vertex, VertexLabel) noexcept {
+        vertex.local = null_vert;
+      });
+  }
+
+  // Samples around seeds; every call draws afresh
+  SampledSubgraph operator()(std::vector<VertexLabel> const& seeds)
+  {
+    auto& graph = this->graph_;
+    SampledSubgraph sample;
+    auto& vertices = sample.vertices;
+    auto const add = [&](VertexLabel v) {
+      auto& local = graph[v].local;
+      if (local == null_vert) {
+        local = static_cast<VertexLabel>(vertices.size());
+        vertices.push_back(v);
+      }
+      return local;
+    };
+    for (auto const v : seeds) add(v);
+    sample.hop_vertices = { 0, vertices.size() };
+    sample.hop_edges = { 0 };
+
+    auto take = [&](uint32_t const v,
+                  uint32_t const w,
+                  uint64_t const /*v_degree*/) noexcept {
+      auto& vertex = graph[v];
+      auto const position =
+        vertex.position.fetch_add(1, std::memory_order_relaxed);
+      auto *end = this->draws_.data() + vertex.last;
+      auto *it = std::lower_bound(this->draws_.data() + vertex.first,
+        end,
+        position,
+        [](Draw const& draw, EdgeIndexType p) { return draw.position < p; });
+      for (; it != end && it->position == position; ++it) it->target = w;
+    };
+
+    auto const hops = static_cast<std::uint32_t>(this->options_.fanouts.size());
+    for (std::uint32_t hop = 0; hop < hops; ++hop) {
+      auto const begin = sample.hop_vertices[hop];
+      auto const end = sample.hop_vertices[hop + 1];
+      this->DrawPositions(vertices, begin, end, hop);
+      EdgeMap(graph.getAdjacencyGraph(), this->frontier_, take);
+      this->frontier_.Clear();
+
+      for (auto i = begin; i < end; ++i) {
+        auto const& vertex = graph[vertices[i]];
+        for (auto d = vertex.first; d < vertex.last; ++d) {
+          sample.sources.push_back(static_cast<VertexLabel>(i));
+          sample.targets.push_back(add(this->draws_[d].target));
+        }
+      }
+      sample.hop_vertices.push_back(vertices.size());
+      sample.hop_edges.push_back(sample.sources.size());
+    }
+
+    for (auto const v : vertices) graph[v].local = null_vert;
+    ++this->batch_;
+    return sample;
+  }
+};
+
+struct HyperAnfOptions
+{
+  int max_iterations = 100;
+  // of the reachable pairs within the effective diameter
+  double effective_fraction = 0.9;
+  std::uint64_t seed = 0;
+};
+
+// The neighbourhood function of a graph, the number of pairs (u, v) with v
+// at most t hops from u, by HyperANF (Boldi et al.). Every vertex keeps a
+// HyperLogLog counter of the vertices it reaches; a round merges into it
+// the counters of its out-neighbours, so after round t it counts the ball
+// of radius t. Each round is one EdgeMap over all vertices.
+//
+// A thread merges the counters of each run of consecutive edges of one
+// vertex before touching the vertex's own; the runs of a list split across
+// tasks are merged afterwards. The growth of every ball also yields
+// approximate closeness and harmonic centralities.
+//
+// Every vertex holds two counters of Registers bytes. Their relative error,
+// about 1.04 / sqrt(Registers), hardly averages out over the sum: the balls
+// of nearby vertices overlap, and so do their errors.
+template<typename AdjacencyGraph, std::size_t Registers = 64> class HyperAnf
+{
+  using Counter = HyperLogLog<Registers>;
+
+  struct Vertex
+  {
+    Counter current;// ball of the last round
+    Counter next;
+    float reached;// estimated size of current
+    float distance_sum;
+    float harmonic;
+  };
+
+  struct Run
+  {
+    VertexLabel v = null_vert;
+    EdgeIndexType edges = 0;
+    EdgeIndexType degree = 0;
+    Counter counter;
+    // runs short of a whole list
+    std::vector<std::pair<VertexLabel, Counter>> split;
+  };
+
+  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+  HyperAnfOptions const options_;
+
+  void Merge(VertexSubset& all)
+  {
+    auto& graph = this->graph_;
+    tbb::enumerable_thread_specific<Run> runs;
+    auto flush = [&](Run& run) {
+      if (run.edges == 0) return;
+      // a run of the whole list is the only writer
+      if (run.edges == run.degree)
+        graph[run.v].next.Merge(run.counter);
+      else
+        run.split.emplace_back(run.v, run.counter);
+    };
+    auto merge = [&](uint32_t const v,
+                   uint32_t const w,
+                   uint64_t const v_degree) noexcept {
+      auto& run = runs.local();
+      if (run.v != v) {
+        flush(run);
+        run.v = v;
+        run.edges = 0;
+        run.degree = v_degree;
+        run.counter = Counter{};
+      }
+      run.counter.Merge(graph[w].current);
+      ++run.edges;
+    };
+    EdgeMap(graph.getAdjacencyGraph(), all, merge);
+    for (auto& run : runs) {
+      flush(run);
+      for (auto const& [v, counter] : run.split) graph[v].next.Merge(counter);
+    }
+  }
+
+  // Moves every vertex to its ball of radius t; returns the sum of their
+  // sizes and whether any of them grew
+  std::pair<double, bool> Update(int t)
+  {
+    auto& graph = this->graph_;
+    return tbb::parallel_reduce(
+      tbb::blocked_range<VertexLabel>{ 0, graph.max_v() + 1 },
+      std::pair{ 0.0, false },
+      [&](auto const& my_range, std::pair<double, bool> acc) {
+        for (auto v = my_range.begin(); v < my_range.end(); ++v) {
+          auto& vertex = graph[v];
+          if (vertex.current.Merge(vertex.next)) {
+            acc.second = true;
+            auto const estimate =
+              static_cast<float>(vertex.current.Estimate());
+            auto const reached = std::max(vertex.reached, estimate);
+            auto const new_pairs = reached - vertex.reached;
+            vertex.distance_sum += static_cast<float>(t) * new_pairs;
+            vertex.harmonic += new_pairs / static_cast<float>(t);
+            vertex.reached = reached;
+          }
+          acc.first += vertex.reached;
+        }
+        return acc;
+      },
+      [](std::pair<double, bool> a, std::pair<double, bool> b) {
+        return std::pair{ a.first + b.first, a.second || b.second };
+      });
+  }
+
+public:
+  HyperAnf(AdjacencyGraph& graph, HyperAnfOptions options = {})
+    : graph_(graph), options_(options)
+  {}
+
+  struct Result
+  {
+    // Pairs within distance t, for t up to the last round any ball grew
+    std::vector<double> neighborhood_function;
+    // Interpolated distance within which effective_fraction of the pairs
+    // lie
+    double effective_diameter;
+  };
+
+  Result operator()()
+  {
+    auto& graph = this->graph_;
+    auto const seed = this->options_.seed;
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+      vertex.current = Counter{};
+      vertex.current.Add(Mix64(seed ^ v));
+      vertex.next = vertex.current;
+      vertex.reached = static_cast<float>(vertex.current.Estimate());
+      vertex.distance_sum = 0;
+      vertex.harmonic = 0;
+    });
+
+    famgraph::VertexSubset all{ graph.max_v() };
+    all.SetAll();
+    Result result;
+    auto& pairs = result.neighborhood_function;
+    pairs.push_back(this->Update(0).first);
+    for (int t = 1; t <= this->options_.max_iterations; ++t) {
+      this->Merge(all);
+      auto const [sum, grew] = this->Update(t);
+      if (!grew) break;
+      pairs.push_back(sum);
+    }
+
+    auto const target = this->options_.effective_fraction * pairs.back();
+    auto const t = static_cast<std::size_t>(
+      std::lower_bound(pairs.begin(), pairs.end(), target) - pairs.begin());
+    result.effective_diameter =
+      t == 0 ? 0
+             : static_cast<double>(t - 1)
+                 + (target - pairs[t - 1]) / (pairs[t] - pairs[t - 1]);
+    return result;
+  }
+
+  // Reciprocal of the sum of distances to the vertices v reaches
+  double GetCloseness(VertexLabel v) noexcept
+  {
+    auto const distance_sum = this->graph_[v].distance_sum;
+    return distance_sum > 0 ? 1 / static_cast<double>(distance_sum) : 0;
+  }
+
+  // Sum of reciprocal distances to the vertices v reaches
+  double GetHarmonicCentrality(VertexLabel v) noexcept
+  {
+    return this->graph_[v].harmonic;
+  }
+};
+
+// The n largest vertex values of graph, largest first
+template<typename Graph>
+auto TopValues(Graph& graph, VertexLabel n = 20)
+{
+  using Value = decltype(graph[0].value);
+  std::vector<std::pair<Value, VertexLabel>> topN;
+  for (VertexLabel v = 0; v <= graph.max_v(); ++v) {
+    if (topN.size() < n) {
+      topN.push_back(std::make_pair(graph[v].value, v));
+      std::sort(topN.begin(), topN.end());
+    } else {
+      if (graph[v].value > topN.front().first) {
+        topN.front() = std::make_pair(graph[v].value, v);
+        std::sort(topN.begin(), topN.end());
+      }
+    }
+  }
+
+  std::reverse(topN.begin(), topN.end());
+  return topN;
+}
+
+template<typename AdjacencyGraph> class PageRank
+{
+  static constexpr float alpha = 0.85f;
+  static constexpr float epsilon = 0.001f;
+  static constexpr float INIT_RESIDUAL = 1 - alpha;
+
+  struct Vertex
+  {
+    float value;
+    float delta;
+    std::atomic<float> residual;
+
+    bool update_add_atomic(float const s_val) noexcept
+    {
+      auto current = residual.load(std::memory_order_relaxed);
+      while (!residual.compare_exchange_weak(current,
+        current + s_val,
+        std::memory_order_relaxed,
+        std::memory_order_relaxed))
+        ;
+      return true;
+    }
+
+    bool vertex_map() noexcept
+    {
+      auto res = residual.load(std::memory_order_relaxed);
+      if (std::abs(res) > epsilon) {
+        value += res;
+        delta = res;// load up
+        residual.store(0, std::memory_order_relaxed);// clear
+        return true;
+      } else {
+        return false;
+      }
+    }
+  };
+
+  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+
+public:
+  PageRank(AdjacencyGraph& graph) : graph_(graph) {}
+
+  struct Result
+  {
+    int iterations;
+    std::vector<std::pair<float, VertexLabel>> topN;
+  };
+
+  Result operator()()
+  {
+    auto const max_v = this->graph_.max_v();
+    famgraph::VertexSubset frontierA{ max_v };
+    famgraph::VertexSubset frontierB{ max_v };
+
+    auto *frontier = &frontierA;
+    auto *next_frontier = &frontierB;
+
     auto& graph = this->graph_;
     auto& adj_graph = graph.getAdjacencyGraph();
 
@@ -319,27 +1844,578 @@ public:
       ++iterations;
     }
 
-    return { iterations, this->TopN() };
+    return { iterations, TopValues(this->graph_) };
+  }
+};
+
+// How PullPageRank spreads the changes of a round: along the out-edges of
+// the active vertices, along the in-edges of every vertex, or either one
+// depending on how many out-edges the active vertices have
+enum class PageRankMode { PUSH, PULL, HYBRID };
+
+struct PageRankOptions
+{
+  double alpha = 0.85;
+  double tolerance = 0.001;
+  int max_iterations = 100;
+  PageRankMode mode = PageRankMode::HYBRID;
+  // HYBRID pulls while the active vertices hold more than this share of
+  // the out-edges
+  double dense_fraction = 0.05;
+};
+
+// PageRank with the same deltas as PageRank, but dense rounds pull: each
+// vertex sums the contributions of its in-neighbours, read from a
+// transposed graph, and its accumulator is written once per run of its
+// in-edges rather than once per edge. A list is a single run unless
+// RemoteGraph splits it into chunks, so hubs are no longer a point of
+// contention. Sparse rounds push along out-edges as PageRank does.
+template<typename AdjacencyGraph,
+  typename TransposedGraph = AdjacencyGraph,
+  typename Real = float>
+class PullPageRank
+{
+  struct Vertex
+  {
+    Real value;
+    Real delta;
+    Real residual;
+    Real contribution;// of this round, to each out-neighbour
+    std::atomic<Real> incoming;
+    EdgeIndexType degree;
+  };
+
+  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+  TransposedGraph& transposed_;
+  PageRankOptions const options_;
+
+  static void AddAtomic(std::atomic<Real>& x, Real const y) noexcept
+  {
+    auto current = x.load(std::memory_order_relaxed);
+    while (!x.compare_exchange_weak(current,
+      current + y,
+      std::memory_order_relaxed,
+      std::memory_order_relaxed))
+      ;
+  }
+
+  void Push(VertexSubset& frontier)
+  {
+    auto& graph = this->graph_;
+    auto push = [&](uint32_t const v,
+                  uint32_t const w,
+                  uint64_t const /*v_degree*/) noexcept {
+      AddAtomic(graph[w].incoming, graph[v].contribution);
+    };
+    EdgeMap(graph.getAdjacencyGraph(), frontier, push);
+  }
+
+  // A thread's sum over consecutive in-edges of one vertex
+  struct Run
+  {
+    VertexLabel v = null_vert;
+    Real sum = 0;
+    EdgeIndexType edges = 0;
+    EdgeIndexType degree = 0;
+  };
+
+  void Pull(VertexSubset& all)
+  {
+    auto& graph = this->graph_;
+    tbb::enumerable_thread_specific<Run> runs;
+    auto flush = [&](Run const& run) noexcept {
+      if (run.edges == 0) return;
+      auto& incoming = graph[run.v].incoming;
+      // a run of the whole list is the only writer
+      if (run.edges == run.degree)
+        incoming.store(run.sum, std::memory_order_relaxed);
+      else
+        AddAtomic(incoming, run.sum);
+    };
+    auto pull = [&](uint32_t const v,
+                  uint32_t const u,
+                  uint64_t const v_degree) noexcept {
+      auto& run = runs.local();
+      if (run.v != v) {
+        flush(run);
+        run = Run{ v, 0, 0, v_degree };
+      }
+      run.sum += graph[u].contribution;
+      ++run.edges;
+    };
+    EdgeMap(this->transposed_, all, pull);
+    for (auto const& run : runs) flush(run);
+  }
+
+public:
+  PullPageRank(AdjacencyGraph& graph,
+    TransposedGraph& transposed,
+    PageRankOptions options = {})
+    : graph_(graph), transposed_(transposed), options_(options)
+  {}
+
+  struct Result
+  {
+    int iterations;
+    int pull_iterations;
+    std::vector<std::pair<Real, VertexLabel>> topN;
+  };
+
+  Result operator()()
+  {
+    auto const max_v = this->graph_.max_v();
+    famgraph::VertexSubset frontierA{ max_v };
+    famgraph::VertexSubset frontierB{ max_v };
+    famgraph::VertexSubset all{ max_v };
+    all.SetAll();
+
+    auto *frontier = &frontierA;
+    auto *next_frontier = &frontierB;
+
+    auto& graph = this->graph_;
+    auto& adj_graph = graph.getAdjacencyGraph();
+    auto const alpha = static_cast<Real>(this->options_.alpha);
+    auto const tolerance = static_cast<Real>(this->options_.tolerance);
+
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+      vertex.value = 0;
+      vertex.delta = 1 - alpha;
+      vertex.residual = 0;
+      vertex.incoming.store(0, std::memory_order_relaxed);
+      vertex.degree = adj_graph.Degree(v);
+    });
+    frontier->SetAll();
+
+    // out-edges of the vertices in subset, setting their contributions
+    auto contribute = [&](VertexSubset& subset) {
+      return tbb::parallel_reduce(
+        tbb::blocked_range<VertexLabel>{ 0, max_v + 1 },
+        EdgeIndexType{ 0 },
+        [&](auto const& my_range, EdgeIndexType edges) {
+          for (auto v = my_range.begin(); v < my_range.end(); ++v) {
+            auto& vertex = graph[v];
+            auto const active = subset[v] && vertex.degree > 0;
+            vertex.contribution =
+              active ? alpha * vertex.delta / static_cast<Real>(vertex.degree)
+                     : 0;
+            if (active) edges += vertex.degree;
+          }
+          return edges;
+        },
+        [](EdgeIndexType a, EdgeIndexType b) { return a + b; });
+    };
+
+    auto const edges = contribute(all);
+    int iterations = 0;
+    int pull_iterations = 0;
+    while (!frontier->IsEmpty()
+           && iterations < this->options_.max_iterations) {
+      auto const active_edges = contribute(*frontier);
+      auto const mode = this->options_.mode;
+      auto const dense =
+        mode == PageRankMode::PULL
+        || (mode == PageRankMode::HYBRID
+            && static_cast<double>(active_edges)
+                 > this->options_.dense_fraction * static_cast<double>(edges));
+      if (dense) {
+        this->Pull(all);
+        ++pull_iterations;
+      } else {
+        this->Push(*frontier);
+      }
+
+      VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+        vertex.residual += vertex.incoming.load(std::memory_order_relaxed);
+        vertex.incoming.store(0, std::memory_order_relaxed);
+        if (std::abs(vertex.residual) > tolerance) {
+          vertex.value += vertex.residual;
+          vertex.delta = vertex.residual;
+          vertex.residual = 0;
+          next_frontier->Set(v);
+        }
+      });
+      frontier->Clear();
+      std::swap(frontier, next_frontier);
+      ++iterations;
+    }
+
+    return { iterations, pull_iterations, TopValues(graph) };
+  }
+
+  Real GetValue(VertexLabel v) noexcept { return this->graph_[v].value; }
+};
+
+// Single source shortest paths by delta-stepping over a weighted adjacency
+// graph. Tentative distances fall into buckets of width delta; the lowest
+// non-empty bucket is relaxed until it stays empty, so vertices are mostly
+// settled before their edges are relaxed. Vertices pushed past the current
+// bucket wait in a single subset and are sorted into a bucket once it is
+// reached. delta = 1 is Dijkstra's order, a huge delta is Bellman-Ford.
+template<typename AdjacencyGraph> class ShortestPaths
+{
+  using Distance = std::uint64_t;
+  constexpr static auto INF = std::numeric_limits<Distance>::max();
+
+  struct Vertex
+  {
+    std::atomic<Distance> distance{ INF };
+
+    bool update_atomic(Distance const proposed) noexcept
+    {
+      auto current = distance.load(std::memory_order_relaxed);
+      while (proposed < current) {
+        if (distance.compare_exchange_weak(current,
+              proposed,
+              std::memory_order_relaxed,
+              std::memory_order_relaxed))
+          return true;
+      }
+      return false;
+    }
+  };
+
+  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+  Distance const delta_;
+
+  // Least distance in subset that is not below floor, INF if there is none
+  Distance MinDistance(VertexSubset& subset, Distance floor) noexcept
+  {
+    return tbb::parallel_reduce(
+      tbb::blocked_range<VertexLabel>{ 0, this->graph_.max_v() + 1 },
+      INF,
+      [&](auto const& my_range, Distance least) {
+        for (auto v = my_range.begin(); v < my_range.end(); ++v) {
+          if (!subset[v]) continue;
+          auto const d =
+            this->graph_[v].distance.load(std::memory_order_relaxed);
+          if (d >= floor) least = std::min(least, d);
+        }
+        return least;
+      },
+      [](Distance a, Distance b) { return std::min(a, b); });
+  }
+
+public:
+  ShortestPaths(AdjacencyGraph& graph, Distance delta)
+    : graph_(graph), delta_(std::max<Distance>(delta, 1))
+  {}
+
+  struct Result
+  {
+    VertexLabel reached;
+    Distance max_distance;
+    std::uint32_t buckets;
+  };
+
+  Result operator()(VertexLabel start_vertex)
+  {
+    auto const max_v = this->graph_.max_v();
+    famgraph::VertexSubset frontierA{ max_v };
+    famgraph::VertexSubset frontierB{ max_v };
+    famgraph::VertexSubset laterA{ max_v };
+    famgraph::VertexSubset laterB{ max_v };
+
+    auto *frontier = &frontierA;
+    auto *next_frontier = &frontierB;
+    auto *later = &laterA;
+    auto *next_later = &laterB;
+
+    auto& graph = this->graph_;
+    auto& adj_graph = graph.getAdjacencyGraph();
+
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel) noexcept {
+      vertex.distance.store(INF, std::memory_order_relaxed);
+    });
+
+    Distance bucket_end = 0;
+    auto relax = [&](uint32_t const v,
+                   uint32_t const w,
+                   uint32_t const weight,
+                   uint64_t const /*v_degree*/) noexcept {
+      auto const d = graph[v].distance.load(std::memory_order_relaxed) + weight;
+      if (graph[w].update_atomic(d)) {
+        if (d < bucket_end)
+          next_frontier->Set(w);
+        else
+          later->Set(w);
+      }
+    };
+
+    std::uint32_t buckets = 0;
+    graph[start_vertex].distance = 0;
+    later->Set(start_vertex);
+    while (true) {
+      // vertices below bucket_end were settled by an earlier bucket
+      auto const least = this->MinDistance(*later, bucket_end);
+      if (least == INF) break;
+      auto const settled = bucket_end;
+      bucket_end = (least / this->delta_ + 1) * this->delta_;
+      famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+        if (!(*later)[v]) return;
+        auto const d = vertex.distance.load(std::memory_order_relaxed);
+        if (d < settled) return;
+        if (d < bucket_end)
+          frontier->Set(v);
+        else
+          next_later->Set(v);
+      });
+      later->Clear();
+      std::swap(later, next_later);
+
+      while (!frontier->IsEmpty()) {
+        EdgeMapWeighted(adj_graph, *frontier, relax);
+        frontier->Clear();
+        std::swap(frontier, next_frontier);
+      }
+      ++buckets;
+    }
+
+    return this->Summary(buckets);
+  }
+
+  // INF for vertices the last run did not reach
+  Distance GetDistance(VertexLabel v) noexcept
+  {
+    return this->graph_[v].distance.load(std::memory_order_relaxed);
   }
 
 private:
-  auto TopN(VertexLabel n = 20)
+  Result Summary(std::uint32_t buckets) noexcept
   {
-    std::vector<std::pair<float, VertexLabel>> topN;
+    VertexLabel reached = 0;
+    Distance max_distance = 0;
     for (VertexLabel v = 0; v <= this->graph_.max_v(); ++v) {
-      if (topN.size() < n) {
-        topN.push_back(std::make_pair(graph_[v].value, v));
-        std::sort(topN.begin(), topN.end());
-      } else {
-        if (graph_[v].value > topN.front().first) {
-          topN.front() = std::make_pair(graph_[v].value, v);
-          std::sort(topN.begin(), topN.end());
+      auto const d = this->GetDistance(v);
+      if (d == INF) continue;
+      ++reached;
+      max_distance = std::max(max_distance, d);
+    }
+    return { reached, max_distance, buckets };
+  }
+};
+
+struct TriangleCountingOptions
+{
+  // Oriented adjacency words held in local memory at a time, see
+  // TriangleCounting; 0 holds all of them
+  std::uint64_t max_local_edges = std::uint64_t{ 1 } << 27;
+};
+
+// Triangles and local clustering coefficients of a symmetric graph. Every
+// edge is oriented from the endpoint of lower degree to the one of higher
+// degree (ties broken by label), which leaves each vertex at most
+// O(sqrt(|E|)) out-neighbours. A triangle is then found exactly once, as
+// a common out-neighbour x of an oriented edge (v, w).
+//
+// The oriented lists are copied to local memory by EdgeMap passes, so a
+// RemoteGraph streams its lists in batches and the intersections never
+// wait on a read. They hold half of the adjacency words, so they are cut
+// into vertex ranges of at most max_local_edges / 2 oriented words each
+// (a single longer list makes a range of its own), and every pair of ranges
+// is counted in turn: the oriented edges (v, w) with v in the first and w
+// in the second. At most two ranges are held at a time, so local memory
+// stays within max_local_edges words plus an index entry per vertex, at
+// the cost of reading the lists of the second ranges once per first range.
+template<typename AdjacencyGraph> class TriangleCounting
+{
+  struct Vertex
+  {
+    std::atomic<std::uint32_t> triangles;
+    std::atomic<std::uint32_t> oriented_degree;
+    std::uint64_t degree;
+  };
+
+  // The sorted oriented lists of [first, end), list v at
+  // words[index[v] - index[first]]
+  struct Lists
+  {
+    VertexLabel first;
+    VertexLabel end;
+    std::unique_ptr<VertexLabel[]> words;
+  };
+
+  famgraph::Graph<Vertex, AdjacencyGraph> graph_;
+  TriangleCountingOptions const options_;
+  std::vector<EdgeIndexType> oriented_index_;
+
+  bool Precedes(VertexLabel v, VertexLabel w) noexcept
+  {
+    auto const dv = this->graph_[v].degree;
+    auto const dw = this->graph_[w].degree;
+    return dv < dw || (dv == dw && v < w);
+  }
+
+  // Offsets of the oriented lists, from one EdgeMap pass counting them
+  void CountOriented()
+  {
+    auto& graph = this->graph_;
+    auto& adj_graph = graph.getAdjacencyGraph();
+    auto const max_v = graph.max_v();
+    famgraph::VertexSubset all{ max_v };
+    all.SetAll();
+
+    auto count = [&](uint32_t const v,
+                   uint32_t const w,
+                   uint64_t const /*v_degree*/) noexcept {
+      if (this->Precedes(v, w))
+        graph[v].oriented_degree.fetch_add(1, std::memory_order_relaxed);
+    };
+    EdgeMap(adj_graph, all, count);
+
+    this->oriented_index_.assign(std::size_t{ max_v } + 2, 0);
+    for (VertexLabel v = 0; v <= max_v; ++v) {
+      this->oriented_index_[v + 1] =
+        this->oriented_index_[v]
+        + graph[v].oriented_degree.exchange(0, std::memory_order_relaxed);
+    }
+  }
+
+  // First vertices of ranges of at most half of max_local_edges oriented
+  // words each, and max_v + 1
+  std::vector<VertexLabel> CutRanges() const
+  {
+    auto const& index = this->oriented_index_;
+    auto const end = static_cast<VertexLabel>(index.size() - 1);
+    auto const limit = this->options_.max_local_edges / 2;
+    std::vector<VertexLabel> cuts{ 0 };
+    if (this->options_.max_local_edges != 0) {
+      for (VertexLabel v = 0; v < end; ++v) {
+        if (v != cuts.back() && index[v + 1] - index[cuts.back()] > limit)
+          cuts.push_back(v);
+      }
+    }
+    cuts.push_back(end);
+    return cuts;
+  }
+
+  Lists Load(VertexLabel first, VertexLabel end)
+  {
+    auto& graph = this->graph_;
+    auto& adj_graph = graph.getAdjacencyGraph();
+    auto const& index = this->oriented_index_;
+    auto const base = index[first];
+    Lists lists{ first,
+      end,
+      std::make_unique<VertexLabel[]>(index[end] - base) };
+    famgraph::VertexSubset all{ graph.max_v() };
+    all.SetAll();
+
+    auto fill = [&](uint32_t const v,
+                  uint32_t const w,
+                  uint64_t const /*v_degree*/) noexcept {
+      if (!this->Precedes(v, w)) return;
+      auto const k =
+        graph[v].oriented_degree.fetch_add(1, std::memory_order_relaxed);
+      lists.words[index[v] - base + k] = w;
+    };
+    EdgeMap(
+      adj_graph, all, fill, tbb::blocked_range<VertexLabel>{ first, end });
+
+    // chunks of a list may be traversed concurrently, in any order
+    tbb::parallel_for(tbb::blocked_range<VertexLabel>{ first, end },
+      [&](auto const& my_range) {
+        for (auto v = my_range.begin(); v < my_range.end(); ++v) {
+          graph[v].oriented_degree.store(0, std::memory_order_relaxed);
+          std::sort(&lists.words[index[v] - base],
+            &lists.words[index[v + 1] - base]);
+        }
+      });
+    return lists;
+  }
+
+  VertexLabel const *List(Lists const& lists, VertexLabel v) const noexcept
+  {
+    return lists.words.get() + this->oriented_index_[v]
+           - this->oriented_index_[lists.first];
+  }
+
+  // Triangles of the oriented edges (v, w), v in from and w in to
+  std::uint64_t Count(Lists const& from, Lists const& to)
+  {
+    auto& graph = this->graph_;
+    auto const& index = this->oriented_index_;
+    return tbb::parallel_reduce(
+      tbb::blocked_range<VertexLabel>{ from.first, from.end },
+      std::uint64_t{ 0 },
+      [&](auto const& my_range, std::uint64_t found) {
+        for (auto v = my_range.begin(); v < my_range.end(); ++v) {
+          auto const *v_list = this->List(from, v);
+          auto const v_size = index[v + 1] - index[v];
+          for (std::size_t i = 0; i < v_size; ++i) {
+            auto const w = v_list[i];
+            if (w < to.first || w >= to.end) continue;
+            Intersect(v_list,
+              v_size,
+              this->List(to, w),
+              index[w + 1] - index[w],
+              [&](VertexLabel x) {
+                ++found;
+                graph[v].triangles.fetch_add(1, std::memory_order_relaxed);
+                graph[w].triangles.fetch_add(1, std::memory_order_relaxed);
+                graph[x].triangles.fetch_add(1, std::memory_order_relaxed);
+              });
+          }
+        }
+        return found;
+      },
+      [](std::uint64_t a, std::uint64_t b) { return a + b; });
+  }
+
+public:
+  TriangleCounting(AdjacencyGraph& graph, TriangleCountingOptions options = {})
+    : graph_(graph), options_{ options }
+  {}
+
+  struct Result
+  {
+    std::uint64_t triangles;
+    double average_clustering;
+  };
+
+  Result operator()()
+  {
+    auto& graph = this->graph_;
+    auto& adj_graph = graph.getAdjacencyGraph();
+
+    famgraph::VertexMap(graph, [&](Vertex& vertex, VertexLabel v) noexcept {
+      vertex.triangles.store(0, std::memory_order_relaxed);
+      vertex.oriented_degree.store(0, std::memory_order_relaxed);
+      vertex.degree = adj_graph.Degree(v);
+    });
+    this->CountOriented();
+
+    auto const cuts = this->CutRanges();
+    std::uint64_t triangles = 0;
+    for (std::size_t i = 0; i + 1 < cuts.size(); ++i) {
+      auto const from = this->Load(cuts[i], cuts[i + 1]);
+      for (std::size_t j = 0; j + 1 < cuts.size(); ++j) {
+        if (j == i) {
+          triangles += this->Count(from, from);
+        } else {
+          auto const to = this->Load(cuts[j], cuts[j + 1]);
+          triangles += this->Count(from, to);
         }
       }
     }
 
-    std::reverse(topN.begin(), topN.end());
-    return topN;
+    double clustering = 0;
+    for (VertexLabel v = 0; v <= graph.max_v(); ++v) {
+      clustering += this->GetClusteringCoefficient(v);
+    }
+    return { triangles, clustering / graph.NumVertices() };
+  }
+
+  std::uint32_t GetTriangles(VertexLabel v) noexcept
+  {
+    return this->graph_[v].triangles.load(std::memory_order_relaxed);
+  }
+
+  // Share of v's neighbour pairs that are adjacent; 0 below degree 2
+  double GetClusteringCoefficient(VertexLabel v) noexcept
+  {
+    auto const d = static_cast<double>(this->graph_[v].degree);
+    if (d < 2) return 0;
+    return 2 * this->GetTriangles(v) / (d * (d - 1));
   }
 };
 }// namespace famgraph
@@ -0,0 +1,86 @@
+#ifndef FAM_HYPERLOGLOG_HPP
+#define FAM_HYPERLOGLOG_HPP
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace famgraph {
+
+// A HyperLogLog counter (Flajolet et al.) of one-byte registers, with linear
+// counting for small cardinalities. Its relative standard error is about
+// 1.04 / sqrt(Registers).
+template<std::size_t Registers> struct HyperLogLog
+{
+  static_assert(Registers >= 16 && (Registers & (Registers - 1)) == 0,
+    "Registers must be a power of two of at least 16");
+
+  constexpr static int index_bits = __builtin_ctzll(Registers);
+
+  alignas(16) std::array<std::uint8_t, Registers> registers{};
+
+  // Adds the element of 64-bit hash h
+  void Add(std::uint64_t h) noexcept
+  {
+    auto const j = h & (Registers - 1);
+    auto const rest = h >> index_bits;
+    auto const rank = static_cast<std::uint8_t>(
+      rest == 0 ? 64 - index_bits + 1 : __builtin_ctzll(rest) + 1);
+    if (rank > this->registers[j]) this->registers[j] = rank;
+  }
+
+  // Register-wise maximum with other, sixteen registers at a time; true if
+  // any register grew
+  bool Merge(HyperLogLog const& other) noexcept
+  {
+#if defined(__SSE2__)
+    int grew = 0;
+    for (std::size_t k = 0; k < Registers; k += 16) {
+      auto *p = reinterpret_cast<__m128i *>(this->registers.data() + k);
+      auto const a = _mm_loadu_si128(p);
+      auto const b = _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(other.registers.data() + k));
+      auto const max = _mm_max_epu8(a, b);
+      grew |= _mm_movemask_epi8(_mm_cmpeq_epi8(max, a)) ^ 0xFFFF;
+      _mm_storeu_si128(p, max);
+    }
+    return grew != 0;
+#else
+    bool grew = false;
+    for (std::size_t k = 0; k < Registers; ++k) {
+      if (other.registers[k] > this->registers[k]) {
+        this->registers[k] = other.registers[k];
+        grew = true;
+      }
+    }
+    return grew;
+#endif
+  }
+
+  double Estimate() const noexcept
+  {
+    double sum = 0;
+    std::size_t zeros = 0;
+    for (auto const r : this->registers) {
+      sum += std::ldexp(1.0, -r);
+      if (r == 0) ++zeros;
+    }
+    constexpr auto m = static_cast<double>(Registers);
+    constexpr auto alpha = Registers == 16   ? 0.673
+                           : Registers == 32 ? 0.697
+                           : Registers == 64 ? 0.709
+                                             : 0.7213 / (1 + 1.079 / m);
+    auto const estimate = alpha * m * m / sum;
+    if (estimate <= 2.5 * m && zeros != 0)
+      return m * std::log(m / static_cast<double>(zeros));
+    return estimate;
+  }
+};
+}// namespace famgraph
+
+#endif// FAM_HYPERLOGLOG_HPP
@@ -0,0 +1,108 @@
+#ifndef FAM_INTERSECTION_HPP
+#define FAM_INTERSECTION_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace famgraph {
+
+// Lists at least this many times longer than the other are galloped through
+// rather than merged
+constexpr std::size_t gallop_ratio = 32;
+
+// Calls f(x) for every x in both a and b, in increasing order. Both lists
+// must be sorted and free of duplicates. Blocks of four elements are compared
+// all against all, the block with the smaller last element moving on.
+template<typename Function>
+void IntersectMerge(std::uint32_t const *a,
+  std::size_t na,
+  std::uint32_t const *b,
+  std::size_t nb,
+  Function&& f)
+{
+  std::size_t i = 0;
+  std::size_t j = 0;
+#if defined(__SSE2__)
+  while (i + 4 <= na && j + 4 <= nb) {
+    auto const va = _mm_loadu_si128(reinterpret_cast<__m128i const *>(a + i));
+    auto const vb = _mm_loadu_si128(reinterpret_cast<__m128i const *>(b + j));
+    // vb rotated by one, two and three lanes
+    auto const eq = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+        _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x39))),
+      _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x4E)),
+        _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x93))));
+    auto mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+    while (mask != 0) {
+      f(a[i + static_cast<std::size_t>(__builtin_ctz(mask))]);
+      mask &= mask - 1;
+    }
+    auto const a_last = a[i + 3];
+    auto const b_last = b[j + 3];
+    if (a_last <= b_last) i += 4;
+    if (b_last <= a_last) j += 4;
+  }
+#endif
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) {
+      ++i;
+    } else if (b[j] < a[i]) {
+      ++j;
+    } else {
+      f(a[i]);
+      ++i;
+      ++j;
+    }
+  }
+}
+
+// Intersection of a short list with a much longer one: each element of the
+// short list is looked up by exponential search from where the previous one
+// was found
+template<typename Function>
+void IntersectGallop(std::uint32_t const *short_list,
+  std::size_t n_short,
+  std::uint32_t const *long_list,
+  std::size_t n_long,
+  Function&& f)
+{
+  std::size_t lo = 0;
+  for (std::size_t i = 0; i < n_short && lo < n_long; ++i) {
+    auto const x = short_list[i];
+    std::size_t step = 1;
+    auto hi = lo;
+    while (hi < n_long && long_list[hi] < x) {
+      lo = hi + 1;
+      hi += step;
+      step *= 2;
+    }
+    hi = std::min(hi + 1, n_long);
+    lo = static_cast<std::size_t>(
+      std::lower_bound(long_list + lo, long_list + hi, x) - long_list);
+    if (lo < n_long && long_list[lo] == x) f(x);
+  }
+}
+
+template<typename Function>
+void Intersect(std::uint32_t const *a,
+  std::size_t na,
+  std::uint32_t const *b,
+  std::size_t nb,
+  Function&& f)
+{
+  if (na == 0 || nb == 0) return;
+  if (nb / gallop_ratio > na)
+    IntersectGallop(a, na, b, nb, f);
+  else if (na / gallop_ratio > nb)
+    IntersectGallop(b, nb, a, na, f);
+  else
+    IntersectMerge(a, na, b, nb, f);
+}
+}// namespace famgraph
+
+#endif// FAM_INTERSECTION_HPP
@@ -1,6 +1,8 @@
 #include <functional>
 #include <iostream>
 #include <exception>
+#include <string>
+#include <vector>
 
 #include <spdlog/spdlog.h>
 #include <boost/program_options.hpp>
@@ -16,7 +18,11 @@ int main(int argc, const char **argv)
     po::value<std::string>()->default_value("0.0.0.0"),
     "Server's IPoIB addr")(
     "port,p", po::value<std::string>()->default_value("50051"), "server port")(
-    "memserver-port, m", po::value<std::uint64_t>()->default_value(35287));
+    "memserver-port, m", po::value<std::uint64_t>()->default_value(35287))(
+    "preload",
+    po::value<std::vector<std::string>>()->multitoken(),
+    "Files to load at startup and keep resident")("retain-files",
+    "Keep mapped files resident after the last session using them ends");
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
   po::notify(vm);
@@ -34,10 +40,15 @@ int main(int argc, const char **argv)
   auto const host = vm["server-addr"].as<std::string>();
   auto const port = vm["port"].as<std::string>();
   auto const memserver_port = vm["memserver-port"].as<std::uint64_t>();
+  auto const preload_files = vm.count("preload")
+                               ? vm["preload"].as<std::vector<std::string>>()
+                               : std::vector<std::string>{};
+  bool const retain_files = vm.count("retain-files") != 0;
 
   spdlog::info("Starting Server");
   try {
-    FAM::server::RunServer(host, port, memserver_port);
+    FAM::server::RunServer(
+      host, port, memserver_port, preload_files, retain_files);
   } catch (std::exception const &e) {
     spdlog::error("Caught Runtime Exception {}", e.what());
   }
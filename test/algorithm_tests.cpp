@@ -1,8 +1,18 @@
 #include <catch2/catch.hpp>
 #include <fmt/core.h>
 
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
 #include <map>
+#include <numeric>
+#include <random>
+#include <stdexcept>
 #include <string_view>
+#include <system_error>
+
+#include <stdlib.h>
+#include <unistd.h>
 
 #include <constants.hpp>
 #include <famgraph.hpp>
@@ -64,6 +74,9 @@ auto constexpr gnutella_symmetric =
 auto constexpr twitter7_symmetric =
   LARGE_TEST_GRAPH_DIR "/twitter7-undirected"sv;
 
+auto constexpr gnutella_transpose =
+  TEST_GRAPH_DIR "/Gnutella04-transpose/p2p-Gnutella04-transpose"sv;
+
 const std::map<BfsKey, unsigned int> bfs_reference_output{ { { small, 0 }, 4 },
   { { gnutella, 0 }, 21 },
   { { last_vert_nonempty, 0 }, 2 },
@@ -90,6 +103,71 @@ const std::map<std::string_view, ConnectedComponentsResult>
     { twitter7_symmetric, { 2, 1, 41652230 } },
   };
 
+// On a symmetric graph strong and weak components are the connected ones
+const std::map<std::string_view, ConnectedComponentsResult>
+  strongly_connected_output{
+    { gnutella, { 6563, 1, 4317 } },
+    { small_symmetric, { 6, 3, 7 } },
+    { gnutella_symmetric, { 4, 1, 10876 } },
+  };
+
+const std::map<std::string_view, ConnectedComponentsResult>
+  weakly_connected_output{
+    { small, { 6, 3, 7 } },
+    { gnutella, { 4, 1, 10876 } },
+  };
+
+struct LabelPropagationResult
+{
+  int iterations;
+  ConnectedComponentsResult communities;
+};
+// deterministic mode
+const std::map<std::string_view, LabelPropagationResult>
+  label_propagation_output{
+    { small_symmetric, { 4, { 6, 3, 7 } } },
+    { gnutella_symmetric, { 15, { 55, 52, 10713 } } },
+  };
+
+struct NeighborhoodFunction
+{
+  std::vector<double> pairs;// within distance t, exact
+  double effective_diameter;
+};
+const std::map<std::string_view, NeighborhoodFunction>
+  neighborhood_function_output{
+    { small, { { 15, 27, 33, 37, 39 }, 2.525 } },
+    { gnutella,
+      { { 10879,
+          50873,
+          229249,
+          987398,
+          3852580,
+          11662797,
+          23757456,
+          34096457,
+          40160072,
+          43253004,
+          44819513,
+          45696574,
+          46233487,
+          46545655,
+          46717105,
+          46820517,
+          46889662,
+          46943699,
+          46991562,
+          47029903,
+          47053311,
+          47063360,
+          47065648,
+          47066009,
+          47066070,
+          47066085,
+          47066089 },
+        8.711 } },
+  };
+
 struct PageRankResult
 {
   int iterations;
@@ -150,6 +228,60 @@ const std::map<std::string_view, PageRankResult> pagerank_output{
       } } }
 };
 
+// Distances from vertex 0 over the weights in the .wgt files,
+// 1 + (31 * src + 17 * dst) % 16 per edge
+struct ShortestPathsResult
+{
+  famgraph::VertexLabel reached;
+  std::uint64_t max_distance;
+  std::uint64_t distance_sum;
+};
+const std::map<std::string_view, ShortestPathsResult> shortest_paths_output{
+  { small, { 7, 10, 33 } },
+  { gnutella, { 10813, 163, 442320 } },
+};
+
+struct MultiSourceBfsResult
+{
+  famgraph::VertexLabel reached;
+  std::uint32_t max_distance;
+  std::uint64_t distance_sum;
+};
+const std::map<BfsKey, MultiSourceBfsResult> ms_bfs_reference_output{
+  { { small, 0 }, { 7, 4, 12 } },
+  { { small, 1 }, { 6, 4, 11 } },
+  { { gnutella, 0 }, { 10813, 21, 74515 } },
+  { { gnutella, 1 }, { 10813, 21, 73628 } },
+  { { last_vert_nonempty, 0 }, { 3, 2, 3 } },
+  { { last_vert_nonempty, 1 }, { 3, 2, 3 } },
+};
+
+// From every vertex of small graphs, from vertices 0 to 19 of large ones
+struct BetweennessResult
+{
+  famgraph::VertexLabel most_central;
+  double max_centrality;
+  double centrality_sum;
+};
+const std::map<std::string_view, BetweennessResult> betweenness_output{
+  { small, { 5, 6.0, 20.0 } },
+  { small_symmetric, { 6, 7.3333333, 30.0 } },
+  { gnutella, { 46, 12350.050234, 562341.0 } },
+  { gnutella_symmetric, { 0, 14591.097166, 701253.0 } },
+};
+
+struct TriangleCountingResult
+{
+  std::uint64_t triangles;
+  double average_clustering;
+  std::uint32_t vertex0_triangles;
+};
+const std::map<std::string_view, TriangleCountingResult>
+  triangle_counting_output{
+    { small_symmetric, { 1, 0.0666667, 1 } },
+    { gnutella_symmetric, { 934, 0.00621582, 3 } },
+  };
+
 template<typename AdjacencyGraph = famgraph::LocalGraph<>, typename... Args>
 AdjacencyGraph CreateGraph(std::string_view graph_base,
   std::string_view suffix,
@@ -182,6 +314,28 @@ void RunKcore(Graph& graph, std::string_view graph_base, std::uint32_t kcore_k)
   REQUIRE(result.kth_core_membership == kth_core_size);
 }
 
+// One decomposition answers every k of the single-k references
+template<typename Graph>
+void RunCoreDecomposition(Graph& graph,
+  std::string_view graph_base,
+  std::uint32_t max_core)
+{
+  auto core_decomposition = famgraph::CoreDecomposition(graph);
+  auto result = core_decomposition();
+  REQUIRE(result.max_core == max_core);
+  REQUIRE(result.core_sizes.size() == max_core + 1);
+  REQUIRE(result.core_sizes[0] == graph.max_v() + 1);
+  for (auto const& [key, kth_core_size] : kcore_reference_output) {
+    if (key.graph_name == graph_base)
+      REQUIRE(result.core_sizes.at(key.kth_core_size) == kth_core_size);
+  }
+
+  famgraph::VertexLabel in_max_core = 0;
+  for (famgraph::VertexLabel v = 0; v <= graph.max_v(); ++v)
+    if (core_decomposition.GetCoreness(v) == max_core) ++in_max_core;
+  REQUIRE(in_max_core == result.core_sizes.back());
+}
+
 template<typename Graph>
 void RunConnectedComponents(Graph& graph, std::string_view graph_base)
 {
@@ -193,6 +347,271 @@ void RunConnectedComponents(Graph& graph, std::string_view graph_base)
   REQUIRE(result.largest_component_size == reference.largest_component_size);
 }
 
+template<typename Graph>
+void RunAfforest(Graph& graph, std::string_view graph_base)
+{
+  auto afforest = famgraph::Afforest(graph);
+  auto result = afforest();
+  auto reference = connected_components_output.at(graph_base);
+  REQUIRE(result.components == reference.total_components);
+  REQUIRE(result.non_trivial_components == reference.non_trivial_components);
+  REQUIRE(result.largest_component_size == reference.largest_component_size);
+
+  // components are labelled by their least vertex
+  for (famgraph::VertexLabel v = 0; v <= graph.max_v(); ++v)
+    REQUIRE(afforest.GetComponent(v) <= v);
+}
+
+template<typename Graph>
+void RunWeaklyConnected(Graph& graph, std::string_view graph_base)
+{
+  auto afforest = famgraph::Afforest(graph, 2, false);
+  auto result = afforest();
+  auto reference = weakly_connected_output.at(graph_base);
+  REQUIRE(result.components == reference.total_components);
+  REQUIRE(result.non_trivial_components == reference.non_trivial_components);
+  REQUIRE(result.largest_component_size == reference.largest_component_size);
+}
+
+template<typename Graph, typename Transposed>
+void RunStronglyConnected(Graph& graph,
+  Transposed& transposed,
+  std::string_view graph_base)
+{
+  auto scc = famgraph::StronglyConnectedComponents(graph, transposed);
+  auto result = scc();
+  auto reference = strongly_connected_output.at(graph_base);
+  REQUIRE(result.components == reference.total_components);
+  REQUIRE(result.non_trivial_components == reference.non_trivial_components);
+  REQUIRE(result.largest_component_size == reference.largest_component_size);
+
+  // every label is a member of its own component
+  for (famgraph::VertexLabel v = 0; v <= graph.max_v(); ++v) {
+    auto const label = scc.GetComponent(v);
+    REQUIRE(scc.GetComponent(label) == label);
+  }
+}
+
+template<typename Graph>
+void RunLabelPropagation(Graph& graph, std::string_view graph_base)
+{
+  famgraph::LabelPropagationOptions options;
+  options.deterministic = true;
+  auto label_propagation = famgraph::LabelPropagation(graph, options);
+  auto result = label_propagation();
+  auto reference = label_propagation_output.at(graph_base);
+  REQUIRE(result.iterations == reference.iterations);
+  auto const& communities = reference.communities;
+  REQUIRE(result.communities.components == communities.total_components);
+  REQUIRE(result.communities.non_trivial_components
+          == communities.non_trivial_components);
+  REQUIRE(result.communities.largest_component_size
+          == communities.largest_component_size);
+
+  // labels never cross components
+  options.deterministic = false;
+  options.seed = 7;
+  auto asynchronous = famgraph::LabelPropagation(graph, options)();
+  REQUIRE(asynchronous.iterations <= options.max_iterations);
+  REQUIRE(asynchronous.communities.components
+          >= connected_components_output.at(graph_base).total_components);
+}
+
+using EdgeList =
+  std::vector<std::pair<famgraph::VertexLabel, famgraph::VertexLabel>>;
+
+// An empty file of a unique name in the temp directory, so that concurrent
+// test runs do not share it, removed when it goes out of scope
+struct TempFile
+{
+  std::filesystem::path path;
+
+  explicit TempFile(std::string_view prefix)
+  {
+    auto name = (std::filesystem::temp_directory_path()
+                 / fmt::format("{}.XXXXXX", prefix))
+                  .string();
+    auto const fd = mkstemp(name.data());
+    if (fd < 0) throw std::runtime_error("mkstemp() failed");
+    close(fd);
+    path = name;
+  }
+  TempFile(TempFile const&) = delete;
+  TempFile& operator=(TempFile const&) = delete;
+  ~TempFile()
+  {
+    std::error_code ignored;
+    std::filesystem::remove(path, ignored);
+  }
+};
+
+// The sorted edges of graph_base
+EdgeList ReadEdgeList(std::string_view graph_base)
+{
+  std::ifstream ifs{ fmt::format("{}.txt", graph_base) };
+  EdgeList edges;
+  famgraph::VertexLabel u, w;
+  while (ifs >> u >> w) edges.emplace_back(u, w);
+  std::sort(edges.begin(), edges.end());
+  return edges;
+}
+
+template<typename Graph>
+void RunRandomWalks(Graph& graph, std::string_view graph_base)
+{
+  auto const edges = ReadEdgeList(graph_base);
+  auto const is_sink = [&](famgraph::VertexLabel v) {
+    return !std::binary_search(edges.begin(),
+      edges.end(),
+      std::pair{ v, famgraph::VertexLabel{ 0 } },
+      [](auto const& a, auto const& b) { return a.first < b.first; });
+  };
+
+  famgraph::RandomWalkOptions options;
+  options.walk_length = 8;
+  options.walks_per_vertex = 3;
+  options.batch_walkers = 4096;
+  options.seed = 11;
+  auto const n = std::uint64_t{ graph.max_v() } + 1;
+  std::vector<famgraph::VertexLabel> walks;
+  auto random_walks = famgraph::RandomWalks(graph, options);
+  auto const result = random_walks(
+    [&](famgraph::VertexLabel const *batch, std::uint64_t count) {
+      walks.insert(walks.end(), batch, batch + count * options.walk_length);
+    });
+  REQUIRE(result.walks == n * options.walks_per_vertex);
+  REQUIRE(walks.size() == result.walks * options.walk_length);
+
+  std::uint64_t steps = 0;
+  for (std::uint64_t k = 0; k < result.walks; ++k) {
+    auto const *walk = walks.data() + k * options.walk_length;
+    REQUIRE(walk[0] == k % n);
+    for (std::uint32_t s = 1; s < options.walk_length; ++s) {
+      if (walk[s - 1] == famgraph::null_vert || is_sink(walk[s - 1])) {
+        REQUIRE(walk[s] == famgraph::null_vert);
+      } else {
+        REQUIRE(std::binary_search(
+          edges.begin(), edges.end(), std::pair{ walk[s - 1], walk[s] }));
+        ++steps;
+      }
+    }
+  }
+  REQUIRE(result.steps == steps);
+
+  TempFile const walk_file{ "famgraph_random_walks" };
+  random_walks.Write(walk_file.path.string());
+  REQUIRE(std::filesystem::file_size(walk_file.path)
+          == walks.size() * sizeof(famgraph::VertexLabel));
+}
+
+template<typename Graph>
+void RunNeighborSampling(Graph& graph, std::string_view graph_base)
+{
+  auto const edges = ReadEdgeList(graph_base);
+  auto const degree = [&](famgraph::VertexLabel v) {
+    auto const [lo, hi] = std::equal_range(edges.begin(),
+      edges.end(),
+      std::pair{ v, famgraph::VertexLabel{ 0 } },
+      [](auto const& a, auto const& b) { return a.first < b.first; });
+    return static_cast<std::uint64_t>(hi - lo);
+  };
+
+  famgraph::NeighborSamplingOptions options;
+  options.fanouts = { 5, 3 };
+  options.replace = GENERATE(false, true);
+  auto sampler = famgraph::NeighborSampler(graph, options);
+  std::vector<famgraph::VertexLabel> seeds;
+  for (famgraph::VertexLabel v = 0; v <= graph.max_v(); v += 7)
+    seeds.push_back(v);
+
+  for (int batch = 0; batch < 2; ++batch) {
+    auto const sample = sampler(seeds);
+    auto const& vertices = sample.vertices;
+    REQUIRE(sample.hop_vertices.size() == options.fanouts.size() + 2);
+    REQUIRE(sample.hop_edges.size() == options.fanouts.size() + 1);
+    REQUIRE(sample.hop_vertices.back() == vertices.size());
+    REQUIRE(sample.hop_edges.back() == sample.sources.size());
+    REQUIRE(sample.sources.size() == sample.targets.size());
+    REQUIRE(std::equal(seeds.begin(), seeds.end(), vertices.begin()));
+    auto sorted = vertices;
+    std::sort(sorted.begin(), sorted.end());
+    REQUIRE(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+
+    for (std::size_t hop = 0; hop < options.fanouts.size(); ++hop) {
+      auto const fanout = options.fanouts[hop];
+      std::map<famgraph::VertexLabel, std::vector<famgraph::VertexLabel>>
+        sampled;
+      for (auto i = sample.hop_edges[hop]; i < sample.hop_edges[hop + 1];
+           ++i) {
+        auto const source = sample.sources[i];
+        REQUIRE(source >= sample.hop_vertices[hop]);
+        REQUIRE(source < sample.hop_vertices[hop + 1]);
+        REQUIRE(sample.targets[i] < sample.hop_vertices[hop + 2]);
+        auto const v = vertices[source];
+        auto const w = vertices[sample.targets[i]];
+        REQUIRE(std::binary_search(
+          edges.begin(), edges.end(), std::pair{ v, w }));
+        sampled[source].push_back(w);
+      }
+      for (auto i = sample.hop_vertices[hop]; i < sample.hop_vertices[hop + 1];
+           ++i) {
+        auto const d = degree(vertices[i]);
+        auto expected = std::min<std::uint64_t>(fanout, d);
+        if (options.replace && d > 0) expected = fanout;
+        auto& targets = sampled[static_cast<famgraph::VertexLabel>(i)];
+        REQUIRE(targets.size() == expected);
+        std::sort(targets.begin(), targets.end());
+        if (!options.replace)
+          REQUIRE(std::adjacent_find(targets.begin(), targets.end())
+                  == targets.end());
+      }
+    }
+  }
+}
+
+template<typename Graph>
+void RunHyperAnf(Graph& graph, std::string_view graph_base)
+{
+  // counters of 64 registers are off by 20%, of 1024 by 3%
+  auto hyper_anf = famgraph::HyperAnf<Graph, 1024>(graph);
+  auto const result = hyper_anf();
+  auto const& reference = neighborhood_function_output.at(graph_base);
+  auto const& pairs = result.neighborhood_function;
+  auto const rounds = std::min(pairs.size(), reference.pairs.size());
+  for (std::size_t t = 0; t < rounds; ++t) {
+    INFO("t = " << t << ": " << pairs[t] << " / " << reference.pairs[t]);
+    REQUIRE(pairs[t] == Approx(reference.pairs[t]).epsilon(0.1));
+  }
+  REQUIRE(pairs.back() == Approx(reference.pairs.back()).epsilon(0.1));
+  REQUIRE(result.effective_diameter
+          == Approx(reference.effective_diameter).margin(0.5));
+
+  // closeness against exact distance sums
+  auto const edges = ReadEdgeList(graph_base);
+  std::vector<famgraph::VertexLabel> distance(graph.max_v() + 1);
+  for (famgraph::VertexLabel v = 0; v <= graph.max_v(); v += 97) {
+    std::fill(distance.begin(), distance.end(), famgraph::null_vert);
+    std::vector<famgraph::VertexLabel> queue{ v };
+    distance[v] = 0;
+    double distance_sum = 0;
+    for (std::size_t head = 0; head < queue.size(); ++head) {
+      auto const u = queue[head];
+      distance_sum += distance[u];
+      auto it = std::lower_bound(edges.begin(),
+        edges.end(),
+        std::pair{ u, famgraph::VertexLabel{ 0 } });
+      for (; it != edges.end() && it->first == u; ++it) {
+        if (distance[it->second] != famgraph::null_vert) continue;
+        distance[it->second] = distance[u] + 1;
+        queue.push_back(it->second);
+      }
+    }
+    auto const closeness = distance_sum > 0 ? 1 / distance_sum : 0;
+    INFO("vertex " << v);
+    REQUIRE(hyper_anf.GetCloseness(v) == Approx(closeness).epsilon(0.1));
+  }
+}
+
 template<typename Graph>
 void RunPageRank(Graph& graph, std::string_view graph_base)
 {
@@ -213,6 +632,112 @@ void RunPageRank(Graph& graph, std::string_view graph_base)
   }
 }
 
+template<typename Graph>
+void RunShortestPaths(Graph& graph,
+  std::string_view graph_base,
+  std::uint64_t delta)
+{
+  auto shortest_paths = famgraph::ShortestPaths(graph, delta);
+  auto result = shortest_paths(0);
+  auto reference = shortest_paths_output.at(graph_base);
+  REQUIRE(result.reached == reference.reached);
+  REQUIRE(result.max_distance == reference.max_distance);
+  std::uint64_t distance_sum = 0;
+  for (famgraph::VertexLabel v = 0; v <= graph.max_v(); ++v) {
+    auto const d = shortest_paths.GetDistance(v);
+    if (d != std::numeric_limits<std::uint64_t>::max()) distance_sum += d;
+  }
+  REQUIRE(distance_sum == reference.distance_sum);
+}
+
+// Searches from the first Sources vertices at once; each must reach as far
+// as a search of its own
+template<std::size_t Sources, typename Graph>
+void RunMultiSourceBFS(Graph& graph, std::string_view graph_base)
+{
+  std::vector<famgraph::VertexLabel> sources;
+  for (famgraph::VertexLabel v = 0; v <= graph.max_v() && v < Sources; ++v)
+    sources.push_back(v);
+  auto ms_bfs = famgraph::MultiSourceBreadthFirstSearch<Graph, Sources>(graph);
+  auto result = ms_bfs(sources);
+  REQUIRE(result.searches.size() == sources.size());
+
+  for (std::uint32_t s = 0; s < 2 && s < sources.size(); ++s) {
+    auto reference = ms_bfs_reference_output.at({ graph_base, s });
+    REQUIRE(result.searches[s].reached == reference.reached);
+    REQUIRE(result.searches[s].max_distance == reference.max_distance);
+    REQUIRE(result.searches[s].distance_sum == reference.distance_sum);
+  }
+
+  for (std::size_t i = 0; i < sources.size(); i += 7) {
+    auto breadth_first_search = famgraph::BreadthFirstSearch(graph);
+    auto const single = breadth_first_search(sources[i]);
+    REQUIRE(result.searches[i].max_distance == single.max_distance);
+  }
+  std::uint32_t levels = 0;
+  for (auto const& search : result.searches)
+    levels = std::max(levels, search.max_distance);
+  REQUIRE(result.levels == levels);
+}
+
+template<std::size_t Batch, typename Graph>
+void RunBetweenness(Graph& graph, std::string_view graph_base)
+{
+  auto betweenness = famgraph::BetweennessCentrality<Graph, Batch>(graph);
+  auto const n = graph.max_v() + 1;
+  std::vector<famgraph::VertexLabel> sources(std::min(n, 20u));
+  std::iota(sources.begin(), sources.end(), 0u);
+  auto result = sources.size() == n ? betweenness() : betweenness(sources);
+  auto reference = betweenness_output.at(graph_base);
+  REQUIRE(result.sources == sources.size());
+  REQUIRE(result.most_central == reference.most_central);
+  REQUIRE(result.max_centrality == Approx(reference.max_centrality));
+  double sum = 0;
+  for (famgraph::VertexLabel v = 0; v < n; ++v)
+    sum += betweenness.GetCentrality(v);
+  REQUIRE(sum == Approx(reference.centrality_sum));
+}
+
+template<typename Graph>
+void RunTriangleCounting(Graph& graph, std::string_view graph_base)
+{
+  famgraph::TriangleCountingOptions options;
+  // 0 holds every oriented list at once, 2000 cuts Gnutella04 in ranges
+  options.max_local_edges = GENERATE(0u, 2000u);
+  auto triangle_counting = famgraph::TriangleCounting(graph, options);
+  auto result = triangle_counting();
+  auto reference = triangle_counting_output.at(graph_base);
+  REQUIRE(result.triangles == reference.triangles);
+  REQUIRE(result.average_clustering
+          == Approx(reference.average_clustering).epsilon(1e-5));
+  REQUIRE(triangle_counting.GetTriangles(0) == reference.vertex0_triangles);
+}
+
+// Pulling and pushing arrive at the same ranks as PageRank
+template<typename Graph, typename Transposed>
+void RunPullPageRank(Graph& graph,
+  Transposed& transposed,
+  famgraph::PageRankOptions const& options)
+{
+  auto page_rank = famgraph::PageRank(graph);
+  auto const reference = page_rank();
+  auto pull_page_rank = famgraph::PullPageRank<Graph, Transposed, double>(
+    graph, transposed, options);
+  auto const result = pull_page_rank();
+
+  REQUIRE(std::abs(reference.iterations - result.iterations) <= 2);
+  if (options.mode == famgraph::PageRankMode::PULL)
+    REQUIRE(result.pull_iterations == result.iterations);
+  if (options.mode == famgraph::PageRankMode::PUSH)
+    REQUIRE(result.pull_iterations == 0);
+  REQUIRE(result.topN.size() == reference.topN.size());
+  for (std::size_t i = 0; i < reference.topN.size(); ++i) {
+    REQUIRE(result.topN[i].second == reference.topN[i].second);
+    REQUIRE(result.topN[i].first
+            == Approx(reference.topN[i].first).epsilon(1e-3));
+  }
+}
+
 std::vector<std::string_view> const vec{ "", "2" };
 }// namespace
 
@@ -472,4 +997,580 @@ TEMPLATE_TEST_CASE_SIG("Large Graph RemoteGraph PageRank",
     ipoib_port,
     rdma_channels);
   RunPageRank(graph, graph_base);
-}
\ No newline at end of file
+}
+
+TEST_CASE("LocalGraph Shortest Paths", "[local]")
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph_base = GENERATE(small, gnutella);
+  auto delta = GENERATE(1, 8, 1000);
+  auto graph = famgraph::LocalGraph<>::CreateInstance(
+    fmt::format("{}.idx", graph_base),
+    fmt::format("{}.adj", graph_base),
+    fmt::format("{}.wgt", graph_base));
+  RunShortestPaths(graph, graph_base, static_cast<std::uint64_t>(delta));
+}
+
+TEST_CASE("RemoteGraph Shortest Paths", "[rdma]")
+{
+  auto graph_base = GENERATE(small, gnutella);
+  auto delta = GENERATE(1, 8, 1000);
+  int const rdma_channels = 5;
+  tbb::global_control c(
+    tbb::global_control::max_allowed_parallelism, rdma_channels);
+  famgraph::RemoteGraphOptions options;
+  options.weights_file = fmt::format("{}.wgt", graph_base);
+  auto graph = CreateGraph<famgraph::RemoteGraph<>>(graph_base,
+    "",
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels,
+    options);
+  RunShortestPaths(graph, graph_base, static_cast<std::uint64_t>(delta));
+}
+
+TEST_CASE("Sorted Set Intersection", "[local]")
+{
+  std::mt19937 gen(42);
+  // sizes on both sides of the SIMD blocks and of the galloping ratio
+  auto const na = GENERATE(0u, 3u, 4u, 17u, 100u);
+  auto const nb = GENERATE(1u, 8u, 61u, 5000u);
+  auto const universe = GENERATE(64u, 100000u);
+  auto random_set = [&](std::uint32_t n) {
+    std::uniform_int_distribution<std::uint32_t> d(0, universe);
+    std::vector<std::uint32_t> set;
+    while (set.size() < n && set.size() <= universe) {
+      set.push_back(d(gen));
+      std::sort(set.begin(), set.end());
+      set.erase(std::unique(set.begin(), set.end()), set.end());
+    }
+    return set;
+  };
+  auto const a = random_set(na);
+  auto const b = random_set(nb);
+  std::vector<std::uint32_t> expected;
+  std::set_intersection(
+    a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+
+  std::vector<std::uint32_t> merged;
+  famgraph::IntersectMerge(a.data(), a.size(), b.data(), b.size(), [&](auto x) {
+    merged.push_back(x);
+  });
+  REQUIRE(merged == expected);
+
+  std::vector<std::uint32_t> galloped;
+  famgraph::IntersectGallop(a.data(),
+    a.size(),
+    b.data(),
+    b.size(),
+    [&](auto x) { galloped.push_back(x); });
+  REQUIRE(galloped == expected);
+
+  std::vector<std::uint32_t> found;
+  famgraph::Intersect(b.data(), b.size(), a.data(), a.size(), [&](auto x) {
+    found.push_back(x);
+  });
+  REQUIRE(found == expected);
+}
+
+TEMPLATE_TEST_CASE_SIG("LocalGraph Triangle Counting",
+  "[local]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph_base = GENERATE(small_symmetric, gnutella_symmetric);
+  auto graph = CreateGraph<famgraph::LocalGraph<T>>(graph_base, vec[V]);
+  RunTriangleCounting(graph, graph_base);
+}
+
+TEMPLATE_TEST_CASE_SIG("RemoteGraph Triangle Counting",
+  "[rdma]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  auto graph_base = GENERATE(small_symmetric, gnutella_symmetric);
+  int const rdma_channels = 5;
+  tbb::global_control c(
+    tbb::global_control::max_allowed_parallelism, rdma_channels);
+  auto graph = CreateGraph<famgraph::RemoteGraph<T>>(graph_base,
+    vec[V],
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels);
+  RunTriangleCounting(graph, graph_base);
+}
+
+TEMPLATE_TEST_CASE_SIG("LocalGraph Multi-Source Breadth First Search",
+  "[local]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph_base = GENERATE(small, gnutella, last_vert_nonempty);
+  auto graph = CreateGraph<famgraph::LocalGraph<T>>(graph_base, vec[V]);
+  RunMultiSourceBFS<64>(graph, graph_base);
+  RunMultiSourceBFS<256>(graph, graph_base);
+}
+
+TEMPLATE_TEST_CASE_SIG("RemoteGraph Multi-Source Breadth First Search",
+  "[rdma]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  auto graph_base = GENERATE(small, gnutella);
+  int const rdma_channels = 5;
+  tbb::global_control c(
+    tbb::global_control::max_allowed_parallelism, rdma_channels);
+  auto graph = CreateGraph<famgraph::RemoteGraph<T>>(graph_base,
+    vec[V],
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels);
+  RunMultiSourceBFS<64>(graph, graph_base);
+}
+
+TEMPLATE_TEST_CASE_SIG("LocalGraph Betweenness Centrality",
+  "[local]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph_base =
+    GENERATE(small, small_symmetric, gnutella, gnutella_symmetric);
+  auto graph = CreateGraph<famgraph::LocalGraph<T>>(graph_base, vec[V]);
+  RunBetweenness<1>(graph, graph_base);
+  RunBetweenness<8>(graph, graph_base);
+}
+
+TEST_CASE("Sampled Betweenness Centrality", "[local]")
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph = CreateGraph(small_symmetric, "");
+  auto betweenness = famgraph::BetweennessCentrality(graph);
+  // every vertex sampled: exact
+  auto const all = betweenness.Sample(100, 7);
+  REQUIRE(all.sources == graph.max_v() + 1);
+  REQUIRE(all.max_centrality == Approx(7.3333333));
+
+  auto const some = betweenness.Sample(5, 7);
+  REQUIRE(some.sources == 5);
+
+  // a tenth of the sources of Gnutella04 find the vertex that is most
+  // central from all of them, and estimate its centrality closely
+  auto gnutella_graph = CreateGraph(gnutella_symmetric, "");
+  auto gnutella_betweenness = famgraph::BetweennessCentrality(gnutella_graph);
+  auto const sampled = gnutella_betweenness.Sample(1000, 7);
+  REQUIRE(sampled.sources == 1000);
+  REQUIRE(sampled.most_central == 3109);
+  REQUIRE(sampled.max_centrality == Approx(2541042.882077).epsilon(0.15));
+}
+
+TEMPLATE_TEST_CASE_SIG("RemoteGraph Betweenness Centrality",
+  "[rdma]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  auto graph_base = GENERATE(small_symmetric, gnutella_symmetric);
+  int const rdma_channels = 5;
+  tbb::global_control c(
+    tbb::global_control::max_allowed_parallelism, rdma_channels);
+  auto graph = CreateGraph<famgraph::RemoteGraph<T>>(graph_base,
+    vec[V],
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels);
+  RunBetweenness<8>(graph, graph_base);
+}
+
+TEMPLATE_TEST_CASE_SIG("LocalGraph Afforest",
+  "[local]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph_base = GENERATE(small_symmetric, gnutella_symmetric);
+  auto graph = CreateGraph<famgraph::LocalGraph<T>>(graph_base, vec[V]);
+  RunAfforest(graph, graph_base);
+}
+
+TEMPLATE_TEST_CASE_SIG("RemoteGraph Afforest",
+  "[rdma]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  auto graph_base = GENERATE(small_symmetric, gnutella_symmetric);
+  int const rdma_channels = 5;
+  tbb::global_control c(
+    tbb::global_control::max_allowed_parallelism, rdma_channels);
+  auto graph = CreateGraph<famgraph::RemoteGraph<T>>(graph_base,
+    vec[V],
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels);
+  RunAfforest(graph, graph_base);
+}
+
+TEMPLATE_TEST_CASE_SIG("LocalGraph Pull PageRank",
+  "[local]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  famgraph::PageRankOptions options;
+  options.mode = GENERATE(famgraph::PageRankMode::PUSH,
+    famgraph::PageRankMode::PULL,
+    famgraph::PageRankMode::HYBRID);
+  // symmetric graphs are their own transpose
+  auto graph = CreateGraph<famgraph::LocalGraph<T>>(gnutella_symmetric, vec[V]);
+  RunPullPageRank(graph, graph, options);
+}
+
+TEST_CASE("LocalGraph Pull PageRank Transposed", "[local]")
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  famgraph::PageRankOptions options;
+  options.mode = GENERATE(famgraph::PageRankMode::PULL,
+    famgraph::PageRankMode::HYBRID);
+  auto graph = CreateGraph(gnutella, "");
+  auto transposed = CreateGraph(gnutella_transpose, "");
+  RunPullPageRank(graph, transposed, options);
+
+  options.max_iterations = 3;
+  auto page_rank = famgraph::PullPageRank(graph, transposed, options);
+  REQUIRE(page_rank().iterations == 3);
+}
+
+TEST_CASE("RemoteGraph Pull PageRank", "[rdma]")
+{
+  int const rdma_channels = 5;
+  tbb::global_control c(
+    tbb::global_control::max_allowed_parallelism, rdma_channels);
+  famgraph::PageRankOptions options;
+  options.mode = GENERATE(famgraph::PageRankMode::PULL,
+    famgraph::PageRankMode::HYBRID);
+  // small chunks split the in-lists of hubs across tasks
+  famgraph::RemoteGraphOptions graph_options;
+  graph_options.chunk_edges = GENERATE(0u, 16u);
+  auto graph = CreateGraph<famgraph::RemoteGraph<>>(gnutella,
+    "",
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels);
+  auto transposed = CreateGraph<famgraph::RemoteGraph<>>(gnutella_transpose,
+    "",
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels,
+    graph_options);
+  RunPullPageRank(graph, transposed, options);
+}
+
+TEMPLATE_TEST_CASE_SIG("LocalGraph Core Decomposition",
+  "[local]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto [graph_base, max_core] =
+    GENERATE(KcoreKey{ small_symmetric, 2 }, KcoreKey{ gnutella_symmetric, 7 });
+  auto graph = CreateGraph<famgraph::LocalGraph<T>>(graph_base, vec[V]);
+  RunCoreDecomposition(graph, graph_base, max_core);
+}
+
+TEMPLATE_TEST_CASE_SIG("RemoteGraph Core Decomposition",
+  "[rdma]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  auto [graph_base, max_core] =
+    GENERATE(KcoreKey{ small_symmetric, 2 }, KcoreKey{ gnutella_symmetric, 7 });
+  int const rdma_channels = 5;
+  tbb::global_control c(
+    tbb::global_control::max_allowed_parallelism, rdma_channels);
+  auto graph = CreateGraph<famgraph::RemoteGraph<T>>(graph_base,
+    vec[V],
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels);
+  RunCoreDecomposition(graph, graph_base, max_core);
+}
+
+TEMPLATE_TEST_CASE_SIG("LocalGraph Strongly Connected Components",
+  "[local]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  // symmetric graphs are their own transpose
+  auto graph_base = GENERATE(small_symmetric, gnutella_symmetric);
+  auto graph = CreateGraph<famgraph::LocalGraph<T>>(graph_base, vec[V]);
+  RunStronglyConnected(graph, graph, graph_base);
+}
+
+TEST_CASE("LocalGraph Strongly Connected Components Transposed", "[local]")
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph = CreateGraph(gnutella, "");
+  auto transposed = CreateGraph(gnutella_transpose, "");
+  RunStronglyConnected(graph, transposed, gnutella);
+}
+
+TEST_CASE("RemoteGraph Strongly Connected Components", "[rdma]")
+{
+  int const rdma_channels = 5;
+  tbb::global_control c(
+    tbb::global_control::max_allowed_parallelism, rdma_channels);
+  auto graph = CreateGraph<famgraph::RemoteGraph<>>(gnutella,
+    "",
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels);
+  auto transposed = CreateGraph<famgraph::RemoteGraph<>>(gnutella_transpose,
+    "",
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels);
+  RunStronglyConnected(graph, transposed, gnutella);
+}
+
+TEMPLATE_TEST_CASE_SIG("LocalGraph Weakly Connected Components",
+  "[local]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph_base = GENERATE(small, gnutella);
+  auto graph = CreateGraph<famgraph::LocalGraph<T>>(graph_base, vec[V]);
+  RunWeaklyConnected(graph, graph_base);
+}
+
+TEMPLATE_TEST_CASE_SIG("RemoteGraph Weakly Connected Components",
+  "[rdma]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  auto graph_base = GENERATE(small, gnutella);
+  int const rdma_channels = 5;
+  tbb::global_control c(
+    tbb::global_control::max_allowed_parallelism, rdma_channels);
+  auto graph = CreateGraph<famgraph::RemoteGraph<T>>(graph_base,
+    vec[V],
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels);
+  RunWeaklyConnected(graph, graph_base);
+}
+
+TEMPLATE_TEST_CASE_SIG("LocalGraph Label Propagation",
+  "[local]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph_base = GENERATE(small_symmetric, gnutella_symmetric);
+  auto graph = CreateGraph<famgraph::LocalGraph<T>>(graph_base, vec[V]);
+  RunLabelPropagation(graph, graph_base);
+}
+
+TEST_CASE("RemoteGraph Label Propagation", "[rdma]")
+{
+  auto graph_base = GENERATE(small_symmetric, gnutella_symmetric);
+  int const rdma_channels = 5;
+  tbb::global_control c(
+    tbb::global_control::max_allowed_parallelism, rdma_channels);
+  // small chunks split the lists of hubs across tasks
+  famgraph::RemoteGraphOptions graph_options;
+  graph_options.chunk_edges = GENERATE(0u, 16u);
+  auto graph = CreateGraph<famgraph::RemoteGraph<>>(graph_base,
+    "",
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels,
+    graph_options);
+  RunLabelPropagation(graph, graph_base);
+}
+
+TEMPLATE_TEST_CASE_SIG("LocalGraph Random Walks",
+  "[local]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph_base = GENERATE(small, gnutella);
+  auto graph = CreateGraph<famgraph::LocalGraph<T>>(graph_base, vec[V]);
+  RunRandomWalks(graph, graph_base);
+}
+
+TEST_CASE("Random Walk Steps Are Uniform", "[local]")
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph = CreateGraph(small, "");
+  famgraph::RandomWalkOptions options;
+  options.walk_length = 2;
+  options.walks_per_vertex = 3000;
+  // out-edges of vertex 0 of small
+  std::map<famgraph::VertexLabel, int> taken{ { 1, 0 }, { 2, 0 }, { 3, 0 } };
+  famgraph::RandomWalks(graph, options)(
+    [&](famgraph::VertexLabel const *walks, std::uint64_t count) {
+      for (std::uint64_t k = 0; k < count; ++k)
+        if (walks[2 * k] == 0) ++taken.at(walks[2 * k + 1]);
+    });
+  for (auto const& [w, count] : taken) {
+    INFO("edge 0 -> " << w);
+    REQUIRE(count > 800);
+    REQUIRE(count < 1200);
+  }
+}
+
+TEST_CASE("RemoteGraph Random Walks", "[rdma]")
+{
+  auto graph_base = GENERATE(small, gnutella);
+  int const rdma_channels = 5;
+  tbb::global_control c(
+    tbb::global_control::max_allowed_parallelism, rdma_channels);
+  // small chunks split the lists of hubs across tasks
+  famgraph::RemoteGraphOptions graph_options;
+  graph_options.chunk_edges = GENERATE(0u, 16u);
+  auto graph = CreateGraph<famgraph::RemoteGraph<>>(graph_base,
+    "",
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels,
+    graph_options);
+  RunRandomWalks(graph, graph_base);
+}
+
+TEMPLATE_TEST_CASE_SIG("LocalGraph Neighbor Sampling",
+  "[local]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph_base = GENERATE(small, gnutella);
+  auto graph = CreateGraph<famgraph::LocalGraph<T>>(graph_base, vec[V]);
+  RunNeighborSampling(graph, graph_base);
+}
+
+TEST_CASE("Neighbor Samples Are Uniform", "[local]")
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph = CreateGraph(small, "");
+  famgraph::NeighborSamplingOptions options;
+  options.fanouts = { 2 };
+  auto sampler = famgraph::NeighborSampler(graph, options);
+  // pairs of the out-edges 0 -> 1, 2, 3 of small
+  std::map<std::pair<famgraph::VertexLabel, famgraph::VertexLabel>, int>
+    taken;
+  for (int batch = 0; batch < 3000; ++batch) {
+    auto const sample = sampler({ 0 });
+    REQUIRE(sample.targets.size() == 2);
+    auto const a = sample.vertices[sample.targets[0]];
+    auto const b = sample.vertices[sample.targets[1]];
+    ++taken[{ std::min(a, b), std::max(a, b) }];
+  }
+  REQUIRE(taken.size() == 3);
+  for (auto const& [pair, count] : taken) {
+    INFO("edges 0 -> " << pair.first << ", " << pair.second);
+    REQUIRE(count > 800);
+    REQUIRE(count < 1200);
+  }
+}
+
+TEST_CASE("RemoteGraph Neighbor Sampling", "[rdma]")
+{
+  auto graph_base = GENERATE(small, gnutella);
+  int const rdma_channels = 5;
+  tbb::global_control c(
+    tbb::global_control::max_allowed_parallelism, rdma_channels);
+  // small chunks split the lists of hubs across tasks
+  famgraph::RemoteGraphOptions graph_options;
+  graph_options.chunk_edges = GENERATE(0u, 16u);
+  auto graph = CreateGraph<famgraph::RemoteGraph<>>(graph_base,
+    "",
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels,
+    graph_options);
+  RunNeighborSampling(graph, graph_base);
+}
+
+TEMPLATE_TEST_CASE_SIG("LocalGraph HyperANF",
+  "[local]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
+  auto graph_base = GENERATE(small, gnutella);
+  auto graph = CreateGraph<famgraph::LocalGraph<T>>(graph_base, vec[V]);
+  RunHyperAnf(graph, graph_base);
+}
+
+TEST_CASE("HyperLogLog Counter", "[local]")
+{
+  famgraph::HyperLogLog<64> a;
+  famgraph::HyperLogLog<64> b;
+  for (std::uint64_t x = 0; x < 20000; ++x) {
+    a.Add(famgraph::Mix64(x));
+    b.Add(famgraph::Mix64(x + 10000));
+  }
+  REQUIRE(a.Estimate() == Approx(20000).epsilon(0.3));
+  REQUIRE(a.Merge(b));
+  REQUIRE(a.Estimate() == Approx(30000).epsilon(0.3));
+  REQUIRE(!a.Merge(b));
+
+  famgraph::HyperLogLog<16> small_counter;
+  for (std::uint64_t x = 0; x < 4; ++x) small_counter.Add(famgraph::Mix64(x));
+  REQUIRE(small_counter.Estimate() == Approx(4).epsilon(0.3));
+}
+
+TEST_CASE("RemoteGraph HyperANF", "[rdma]")
+{
+  auto graph_base = GENERATE(small, gnutella);
+  int const rdma_channels = 5;
+  tbb::global_control c(
+    tbb::global_control::max_allowed_parallelism, rdma_channels);
+  // small chunks split the lists of hubs across tasks
+  famgraph::RemoteGraphOptions graph_options;
+  graph_options.chunk_edges = GENERATE(0u, 16u);
+  auto graph = CreateGraph<famgraph::RemoteGraph<>>(graph_base,
+    "",
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels,
+    graph_options);
+  RunHyperAnf(graph, graph_base);
+}
@@ -3,6 +3,10 @@
 #include <vector>
 #include <utility>
 #include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 #include <constants.hpp>
 #include <famgraph.hpp>
@@ -112,6 +116,344 @@ TEMPLATE_TEST_CASE_SIG("RemoteGraph Construction",
   CompareEdgeLists(edge_list, edge_list2);
 }
 
+TEMPLATE_TEST_CASE_SIG("RemoteGraph Degree",
+  "[rdma]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  // a single channel is leased by EdgeMap while the callback asks for degrees
+  int const rdma_channels = 1;
+  auto const servers = GENERATE(1, 2);
+  std::vector<famgraph::MemoryServer> memory_servers(
+    servers, { memserver_grpc_addr, ipoib_addr, ipoib_port });
+  auto [graph, graph_base] = CreateGraph<famgraph::RemoteGraph<T>>(
+    vec[V], memory_servers, rdma_channels);
+
+  auto plain_text_edge_list =
+    fmt::format("{}/{}.{}", INPUTS_DIR, graph_base, "txt");
+  auto const edge_list = CreateEdgeList(plain_text_edge_list);
+  std::vector<uint64_t> degrees(graph.max_v() + 1);
+  for (auto const& [v, w] : edge_list) ++degrees[v];
+
+  bool degrees_match = true;
+  for (uint32_t v = 0; v <= graph.max_v(); ++v)
+    degrees_match = degrees_match && graph.Degree(v) == degrees[v];
+  REQUIRE(degrees_match);
+
+  std::mutex m;
+  auto check_degree = [&](uint32_t const /*v*/,
+                        uint32_t const w,
+                        uint64_t const /*v_degree*/) noexcept {
+    auto const degree_w = graph.Degree(w);
+    std::lock_guard<std::mutex> lock{ m };
+    degrees_match = degrees_match && degree_w == degrees[w];
+  };
+  graph.EdgeMap(check_degree);
+  REQUIRE(degrees_match);
+}
+
+TEMPLATE_TEST_CASE_SIG("RemoteGraph Construction Multi-Server",
+  "[rdma]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  int const rdma_channels = 1;
+  auto const servers = GENERATE(2, 3);
+  std::vector<famgraph::MemoryServer> memory_servers(
+    servers, { memserver_grpc_addr, ipoib_addr, ipoib_port });
+  auto [graph, graph_base] = CreateGraph<famgraph::RemoteGraph<T>>(
+    vec[V], memory_servers, rdma_channels);
+
+  auto plain_text_edge_list =
+    fmt::format("{}/{}.{}", INPUTS_DIR, graph_base, "txt");
+  auto const edge_list = CreateEdgeList(plain_text_edge_list);
+
+  std::vector<std::pair<uint32_t, uint32_t>> edge_list2;
+  auto build_edge_list = [&edge_list2](uint32_t const v,
+                           uint32_t const w,
+                           uint64_t const /*v_degree*/) noexcept {
+    edge_list2.emplace_back(std::make_pair(v, w));
+  };
+
+  graph.EdgeMap(build_edge_list);
+  CompareEdgeLists(edge_list, edge_list2);
+}
+
+TEMPLATE_TEST_CASE_SIG("RemoteGraph Gather",
+  "[rdma]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  int const rdma_channels = 1;
+  famgraph::RemoteGraphOptions options;
+  options.gather_threshold = GENERATE(1, 4);
+  auto [graph, graph_base] = CreateGraph<famgraph::RemoteGraph<T>>(vec[V],
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels,
+    options);
+
+  auto plain_text_edge_list =
+    fmt::format("{}/{}.{}", INPUTS_DIR, graph_base, "txt");
+  // every other vertex, so that batches are made of many small segments
+  auto const is_even = [](std::uint32_t v) { return v % 2 == 0; };
+  auto const edge_list = CreateEdgeList(plain_text_edge_list, is_even);
+  famgraph::VertexSubset subset{ graph.max_v() };
+  for (uint32_t v = 0; v <= graph.max_v(); v += 2) subset.Set(v);
+
+  std::vector<std::pair<uint32_t, uint32_t>> edge_list2;
+  auto build_edge_list = [&edge_list2](uint32_t const v,
+                           uint32_t const w,
+                           uint64_t const /*v_degree*/) noexcept {
+    edge_list2.emplace_back(std::make_pair(v, w));
+  };
+
+  graph.EdgeMap(build_edge_list, subset);
+  CompareEdgeLists(edge_list, edge_list2);
+}
+
+TEMPLATE_TEST_CASE_SIG("RemoteGraph Coalesced Reads",
+  "[rdma]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  int const rdma_channels = 1;
+  famgraph::RemoteGraphOptions options;
+  options.coalesce_gap = GENERATE(16, 4096);
+  auto [graph, graph_base] = CreateGraph<famgraph::RemoteGraph<T>>(vec[V],
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels,
+    options);
+
+  auto plain_text_edge_list =
+    fmt::format("{}/{}.{}", INPUTS_DIR, graph_base, "txt");
+  // skipping vertices leaves gaps between the lists that are read
+  auto const is_active = [](std::uint32_t v) { return v % 3 != 1; };
+  auto const edge_list = CreateEdgeList(plain_text_edge_list, is_active);
+  famgraph::VertexSubset subset{ graph.max_v() };
+  for (uint32_t v = 0; v <= graph.max_v(); ++v)
+    if (is_active(v)) subset.Set(v);
+
+  std::vector<std::pair<uint32_t, uint32_t>> edge_list2;
+  auto build_edge_list = [&edge_list2](uint32_t const v,
+                           uint32_t const w,
+                           uint64_t const /*v_degree*/) noexcept {
+    edge_list2.emplace_back(std::make_pair(v, w));
+  };
+
+  graph.EdgeMap(build_edge_list, subset);
+  CompareEdgeLists(edge_list, edge_list2);
+}
+
+TEMPLATE_TEST_CASE_SIG("RemoteGraph Hub Chunks",
+  "[rdma]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  // fewer channels than threads, leases are passed around
+  int const rdma_channels = GENERATE(1, 3);
+  famgraph::RemoteGraphOptions options;
+  auto const nop_chunk_edges = GENERATE(4, 32);
+  // compressed windows have to hold a whole block
+  options.chunk_edges = V == 0 ? nop_chunk_edges : 64;
+  auto [graph, graph_base] = CreateGraph<famgraph::RemoteGraph<T>>(vec[V],
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels,
+    options);
+
+  auto plain_text_edge_list =
+    fmt::format("{}/{}.{}", INPUTS_DIR, graph_base, "txt");
+  auto edge_list = CreateEdgeList(plain_text_edge_list);
+  std::sort(edge_list.begin(), edge_list.end());
+  std::vector<uint64_t> degrees(graph.max_v() + 1);
+  for (auto const& [v, w] : edge_list) ++degrees[v];
+  famgraph::VertexSubset subset{ graph.max_v() };
+  subset.SetAll();
+
+  std::mutex m;
+  bool degrees_match = true;
+  std::vector<std::pair<uint32_t, uint32_t>> edge_list2;
+  auto build_edge_list = [&](uint32_t const v,
+                           uint32_t const w,
+                           uint64_t const v_degree) noexcept {
+    std::lock_guard<std::mutex> lock{ m };
+    degrees_match = degrees_match && v_degree == degrees[v];
+    edge_list2.emplace_back(std::make_pair(v, w));
+  };
+
+  famgraph::EdgeMap(graph, subset, build_edge_list);
+  std::sort(edge_list2.begin(), edge_list2.end());
+  REQUIRE(degrees_match);
+  CompareEdgeLists(edge_list, edge_list2);
+}
+
+TEST_CASE("RemoteGraph Hub Chunks On One Channel", "[rdma]")
+{
+  // the thread that reads a hub holds the only channel while it waits for
+  // the chunk tasks, and must not run another range meanwhile
+  tbb::global_control c(tbb::global_control::max_allowed_parallelism, 8);
+  tbb::task_arena arena{ 8 };
+  famgraph::RemoteGraphOptions options;
+  options.chunk_edges = 4;
+  auto [graph, graph_base] = CreateGraph<famgraph::RemoteGraph<>>(
+    vec[0], memserver_grpc_addr, ipoib_addr, ipoib_port, 1, options);
+
+  auto plain_text_edge_list =
+    fmt::format("{}/{}.{}", INPUTS_DIR, graph_base, "txt");
+  auto edge_list = CreateEdgeList(plain_text_edge_list);
+  std::sort(edge_list.begin(), edge_list.end());
+  famgraph::VertexSubset subset{ graph.max_v() };
+  subset.SetAll();
+
+  std::mutex m;
+  std::vector<std::pair<uint32_t, uint32_t>> edge_list2;
+  auto build_edge_list = [&](uint32_t const v,
+                           uint32_t const w,
+                           uint64_t const /*v_degree*/) noexcept {
+    // give the other threads time to steal chunks
+    std::this_thread::yield();
+    std::lock_guard<std::mutex> lock{ m };
+    edge_list2.emplace_back(std::make_pair(v, w));
+  };
+
+  arena.execute([&] {
+    famgraph::EdgeMap(graph,
+      subset,
+      build_edge_list,
+      famgraph::EdgeBalance::VERTICES);
+  });
+  std::sort(edge_list2.begin(), edge_list2.end());
+  CompareEdgeLists(edge_list, edge_list2);
+}
+
+TEST_CASE("RemoteGraph Rejects Windows Smaller Than A Block", "[rdma]")
+{
+  famgraph::RemoteGraphOptions options;
+  options.chunk_edges = 2;
+  REQUIRE_THROWS_AS(
+    CreateGraph<famgraph::RemoteGraph<famgraph::tools::DeltaDecompressor>>(
+      vec[1], memserver_grpc_addr, ipoib_addr, ipoib_port, 1, options),
+    std::runtime_error);
+}
+
+TEMPLATE_TEST_CASE_SIG("RemoteGraph Batches In Flight",
+  "[rdma]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  int const rdma_channels = 8;
+  famgraph::RemoteGraphOptions options;
+  options.batches_in_flight = GENERATE(2, 8);
+  // small windows, so that lists take many batches
+  options.chunk_edges = V == 0 ? 16 : 64;
+  auto [graph, graph_base] = CreateGraph<famgraph::RemoteGraph<T>>(vec[V],
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels,
+    options);
+
+  auto plain_text_edge_list =
+    fmt::format("{}/{}.{}", INPUTS_DIR, graph_base, "txt");
+  auto edge_list = CreateEdgeList(plain_text_edge_list);
+  std::sort(edge_list.begin(), edge_list.end());
+  famgraph::VertexSubset subset{ graph.max_v() };
+  subset.SetAll();
+
+  std::mutex m;
+  std::vector<std::pair<uint32_t, uint32_t>> edge_list2;
+  auto build_edge_list = [&](uint32_t const v,
+                           uint32_t const w,
+                           uint64_t const /*v_degree*/) noexcept {
+    std::lock_guard<std::mutex> lock{ m };
+    edge_list2.emplace_back(std::make_pair(v, w));
+  };
+
+  famgraph::EdgeMap(graph, subset, build_edge_list);
+  std::sort(edge_list2.begin(), edge_list2.end());
+  CompareEdgeLists(edge_list, edge_list2);
+}
+
+TEMPLATE_TEST_CASE_SIG("RemoteGraph IO Thread",
+  "[rdma]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  int const rdma_channels = 4;
+  famgraph::RemoteGraphOptions options;
+  options.io_thread = true;
+  options.batches_in_flight = GENERATE(1, 4);
+  auto [graph, graph_base] = CreateGraph<famgraph::RemoteGraph<T>>(vec[V],
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels,
+    options);
+
+  auto plain_text_edge_list =
+    fmt::format("{}/{}.{}", INPUTS_DIR, graph_base, "txt");
+  // every other vertex, so that tasks submit lists next to each other's
+  auto const is_even = [](std::uint32_t v) { return v % 2 == 0; };
+  auto edge_list = CreateEdgeList(plain_text_edge_list, is_even);
+  std::sort(edge_list.begin(), edge_list.end());
+  famgraph::VertexSubset subset{ graph.max_v() };
+  for (uint32_t v = 0; v <= graph.max_v(); v += 2) subset.Set(v);
+
+  std::mutex m;
+  std::vector<std::pair<uint32_t, uint32_t>> edge_list2;
+  auto build_edge_list = [&](uint32_t const v,
+                           uint32_t const w,
+                           uint64_t const /*v_degree*/) noexcept {
+    std::lock_guard<std::mutex> lock{ m };
+    edge_list2.emplace_back(std::make_pair(v, w));
+  };
+
+  famgraph::EdgeMap(graph, subset, build_edge_list);
+  std::sort(edge_list2.begin(), edge_list2.end());
+  CompareEdgeLists(edge_list, edge_list2);
+}
+
+TEST_CASE("Channel Pool", "[local]")
+{
+  int const channels = 3;
+  famgraph::ChannelPool pool{ channels };
+  std::atomic<int> leased{ 0 };
+  std::atomic<int> max_leased{ 0 };
+  std::vector<std::atomic<int>> holders(channels);
+  std::atomic<bool> exclusive{ true };
+
+  // Catch2 assertions are not thread safe, only count in the tasks
+  tbb::parallel_for(0, 1000, [&](int) {
+    auto const lease = pool.Acquire();
+    auto& holder = holders.at(static_cast<std::size_t>(lease.Channel()));
+    if (++holder != 1) exclusive = false;
+    auto const now = ++leased;
+    auto max = max_leased.load();
+    while (now > max && !max_leased.compare_exchange_weak(max, now)) {}
+    --leased;
+    --holder;
+  });
+  REQUIRE(exclusive);
+  REQUIRE(max_leased <= channels);
+
+  // a task may hold several channels
+  auto const a = pool.Acquire();
+  auto const b = pool.Acquire();
+  REQUIRE(a.Channel() != b.Channel());
+}
+
 TEMPLATE_TEST_CASE_SIG("LocalGraph Vertex Table",
   "[local]",
   ((typename T, int V), T, V),
@@ -244,6 +586,152 @@ TEMPLATE_TEST_CASE_SIG("Local Filter Edgemap with Ranges",
   CompareEdgeLists(edge_list, edge_list2);
 }
 
+TEMPLATE_TEST_CASE_SIG("Local Edge Balanced Edgemap",
+  "[local]",
+  ((typename T, int V), T, V),
+  (NopDecompressor, 0),
+  (famgraph::tools::DeltaDecompressor, 1))
+{
+  auto [graph, graph_base] = CreateGraph<famgraph::LocalGraph<T>>(vec[V]);
+  auto plain_text_edge_list =
+    fmt::format("{}/{}.{}", INPUTS_DIR, graph_base, "txt");
+
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  auto vertex_subset = RandomVertexSet(graph.max_v(), gen);
+
+  auto filter = [&](std::uint32_t v) { return vertex_subset[v]; };
+  auto edge_list = CreateEdgeList(plain_text_edge_list, filter);
+  std::sort(edge_list.begin(), edge_list.end());
+
+  auto const balance = GENERATE(famgraph::EdgeBalance::VERTICES,
+    famgraph::EdgeBalance::ALL_EDGES,
+    famgraph::EdgeBalance::ACTIVE_EDGES);
+
+  std::mutex m;
+  std::vector<std::pair<uint32_t, uint32_t>> edge_list2;
+  auto build_edge_list = [&](uint32_t const v,
+                           uint32_t const w,
+                           uint64_t const /*v_degree*/) noexcept {
+    std::lock_guard<std::mutex> lock{ m };
+    edge_list2.emplace_back(std::make_pair(v, w));
+  };
+
+  famgraph::EdgeMap(graph, vertex_subset, build_edge_list, balance);
+  std::sort(edge_list2.begin(), edge_list2.end());
+  CompareEdgeLists(edge_list, edge_list2);
+}
+
+// The .wgt files next to small and Gnutella04 hold this weight for each edge
+static std::uint32_t TestWeight(std::uint32_t v, std::uint32_t w)
+{
+  return 1 + (31 * v + 17 * w) % 16;
+}
+
+TEST_CASE("Local Weighted Edgemap", "[local]")
+{
+  auto graph_base = GENERATE("small/small", "Gnutella04/p2p-Gnutella04");
+  auto graph = famgraph::LocalGraph<>::CreateInstance(
+    fmt::format("{}/{}.idx", INPUTS_DIR, graph_base),
+    fmt::format("{}/{}.adj", INPUTS_DIR, graph_base),
+    fmt::format("{}/{}.wgt", INPUTS_DIR, graph_base));
+  auto edge_list =
+    CreateEdgeList(fmt::format("{}/{}.txt", INPUTS_DIR, graph_base));
+  std::sort(edge_list.begin(), edge_list.end());
+  famgraph::VertexSubset subset{ graph.max_v() };
+  subset.SetAll();
+
+  std::mutex m;
+  std::vector<std::pair<uint32_t, uint32_t>> edge_list2;
+  std::atomic<int> wrong_weights{ 0 };
+  auto build_edge_list = [&](uint32_t const v,
+                           uint32_t const w,
+                           uint32_t const weight,
+                           uint64_t const /*v_degree*/) noexcept {
+    if (weight != TestWeight(v, w)) ++wrong_weights;
+    std::lock_guard<std::mutex> lock{ m };
+    edge_list2.emplace_back(std::make_pair(v, w));
+  };
+
+  famgraph::EdgeMapWeighted(graph, subset, build_edge_list);
+  std::sort(edge_list2.begin(), edge_list2.end());
+  REQUIRE(wrong_weights == 0);
+  CompareEdgeLists(edge_list, edge_list2);
+}
+
+TEST_CASE("Remote Weighted Edgemap", "[rdma]")
+{
+  auto graph_base = GENERATE("small/small", "Gnutella04/p2p-Gnutella04");
+  int const rdma_channels = 3;
+  famgraph::RemoteGraphOptions options;
+  options.weights_file = fmt::format("{}/{}.wgt", INPUTS_DIR, graph_base);
+  // lists longer than the window are read a window at a time
+  options.chunk_edges = GENERATE(0u, 4u);
+  options.batches_in_flight = GENERATE(1, 4);
+  options.io_thread = GENERATE(false, true);
+  auto graph = famgraph::RemoteGraph<>::CreateInstance(
+    fmt::format("{}/{}.idx", INPUTS_DIR, graph_base),
+    fmt::format("{}/{}.adj", INPUTS_DIR, graph_base),
+    memserver_grpc_addr,
+    ipoib_addr,
+    ipoib_port,
+    rdma_channels,
+    options);
+  auto edge_list =
+    CreateEdgeList(fmt::format("{}/{}.txt", INPUTS_DIR, graph_base));
+  std::sort(edge_list.begin(), edge_list.end());
+  famgraph::VertexSubset subset{ graph.max_v() };
+  subset.SetAll();
+
+  std::mutex m;
+  std::vector<std::pair<uint32_t, uint32_t>> edge_list2;
+  std::atomic<int> wrong_weights{ 0 };
+  auto build_edge_list = [&](uint32_t const v,
+                           uint32_t const w,
+                           uint32_t const weight,
+                           uint64_t const /*v_degree*/) noexcept {
+    if (weight != TestWeight(v, w)) ++wrong_weights;
+    std::lock_guard<std::mutex> lock{ m };
+    edge_list2.emplace_back(std::make_pair(v, w));
+  };
+
+  famgraph::EdgeMapWeighted(graph, subset, build_edge_list);
+  std::sort(edge_list2.begin(), edge_list2.end());
+  REQUIRE(wrong_weights == 0);
+  CompareEdgeLists(edge_list, edge_list2);
+}
+
+TEST_CASE("Split By Edges", "[local]")
+{
+  auto [graph, graph_base] = CreateGraph<famgraph::LocalGraph<>>("");
+  auto const& idx = graph.Index();
+  auto const end = graph.max_v() + 1;
+  auto const parts = GENERATE(1UL, 3UL, 16UL);
+
+  auto const cuts = famgraph::SplitByEdges(idx, 0, end, parts);
+  REQUIRE(cuts.size() == parts + 1);
+  REQUIRE(cuts.front() == 0);
+  REQUIRE(cuts.back() == end);
+  auto const edges = idx[end - 1].end_exclusive;
+  for (std::size_t k = 0; k < parts; ++k) {
+    REQUIRE(cuts[k] <= cuts[k + 1]);
+    if (cuts[k] == cuts[k + 1]) continue;
+    // a range overshoots its share by at most the list it ends with
+    auto const words =
+      idx[cuts[k + 1] - 1].end_exclusive - idx[cuts[k]].begin;
+    REQUIRE(words <= edges / parts + 1 + idx.max_out_degree);
+  }
+
+  famgraph::VertexSubset subset{ graph.max_v() };
+  for (std::uint32_t v = 0; v < end; v += 3) subset.Set(v);
+  auto const active_cuts =
+    famgraph::SplitByActiveEdges(idx, subset, 0, end, parts);
+  REQUIRE(active_cuts.front() == 0);
+  REQUIRE(active_cuts.back() == end);
+  REQUIRE(active_cuts.size() <= parts + 1);
+  REQUIRE(std::is_sorted(active_cuts.begin(), active_cuts.end()));
+}
+
 TEMPLATE_TEST_CASE_SIG("Remote Filter Edgemap",
   "[rdma]",
   ((typename T, int V), T, V),
@@ -4,7 +4,10 @@
 #include <FAM_constants.hpp>
 #include <string>
 
+#include <atomic>
 #include <chrono>
+#include <thread>
+#include <vector>
 
 namespace {
 auto const memserver_grpc_addr = MEMADDR;
@@ -105,6 +108,123 @@ TEST_CASE("rdma mmap", "[rdma]")
   for (int i = 0; i < 10; ++i) REQUIRE(p[i] == i);
 }
 
+TEST_CASE("RPC FileSize", "[RPC]")
+{
+  FAM::FamControl client{ memserver_grpc_addr, ipoib_addr, ipoib_port, 1 };
+
+  REQUIRE(client.FileSize(mmap_test1) == 40);
+  REQUIRE_THROWS(client.FileSize("/this/file/does/not/exist"));
+}
+
+TEST_CASE("rdma mmap file range", "[rdma]")
+{
+  FAM::FamControl client{ memserver_grpc_addr, ipoib_addr, ipoib_port, 1 };
+
+  uint64_t constexpr offset = 3 * sizeof(int);
+  uint64_t constexpr length = 5 * sizeof(int);
+
+  auto const [laddr, l1, lkey] = client.CreateRegion(length, false, false);
+  auto const [raddr, l2, rkey] =
+    client.MmapRemoteFile(mmap_test1, offset, length);
+
+  REQUIRE(l2 == length);
+
+  int volatile *p = reinterpret_cast<int volatile *>(laddr);
+  constexpr auto magic = 0x0FFFFFFF;
+  p[0] = magic;
+  p[4] = magic;
+  client.Read(const_cast<int *>(p), raddr, length, lkey, rkey, 0);
+  while (p[0] == magic || p[4] == magic) {}
+
+  for (int i = 0; i < 5; ++i) REQUIRE(p[i] == i + 3);
+
+  REQUIRE_THROWS(client.MmapRemoteFile(mmap_test1, 36, 8));
+}
+
+TEST_CASE("rdma mmap shared across clients", "[rdma]")
+{
+  FAM::FamControl client1{ memserver_grpc_addr, ipoib_addr, ipoib_port, 1 };
+  FAM::FamControl client2{ memserver_grpc_addr, ipoib_addr, ipoib_port, 1 };
+
+  auto const region1 = client1.MmapRemoteFile(mmap_test1);
+  auto const region2 = client2.MmapRemoteFile(mmap_test1);
+  REQUIRE(region1.raddr == region2.raddr);
+  REQUIRE(region1.rkey == region2.rkey);
+  REQUIRE(region1.length == region2.length);
+
+  auto const range = client2.MmapRemoteFile(mmap_test1, 4, 8);
+  REQUIRE(range.raddr != region1.raddr);
+}
+
+TEST_CASE("rdma mmap progressive", "[rdma]")
+{
+  FAM::FamControl client{ memserver_grpc_addr, ipoib_addr, ipoib_port, 1 };
+
+  uint64_t constexpr filesize = 40;// bytes
+
+  auto const [laddr, l1, lkey] = client.CreateRegion(filesize, false, false);
+  auto const [flags, l2, flags_lkey] = client.CreateRegion(1, false, false);
+  auto const file = client.MmapRemoteFileAsync(mmap_test1);
+
+  REQUIRE(file.data.length == filesize);
+  REQUIRE(file.ready.length == 1);
+  REQUIRE(file.chunk_size >= filesize);
+
+  using RemoteFile = FAM::FamControl::RemoteFile;
+  auto volatile *ready = static_cast<std::uint8_t volatile *>(flags);
+  int constexpr unset = 0xFF;
+  do {
+    *ready = unset;
+    client.Read(const_cast<std::uint8_t *>(ready),
+      file.ready.raddr,
+      1,
+      flags_lkey,
+      file.ready.rkey,
+      0);
+    while (*ready == unset) {}
+  } while (*ready == RemoteFile::chunk_loading);
+  REQUIRE(*ready == RemoteFile::chunk_ready);
+
+  int volatile *p = reinterpret_cast<int volatile *>(laddr);
+  constexpr auto magic = 0x0FFFFFFF;
+  *p = magic;
+  client.Read(
+    const_cast<int *>(p), file.data.raddr, filesize, lkey, file.data.rkey, 0);
+  while (*p == magic) {}
+  for (int i = 0; i < 10; ++i) REQUIRE(p[i] == i);
+}
+
+TEST_CASE("rdma concurrent sessions", "[rdma]")
+{
+  FAM::FamControl client{ memserver_grpc_addr, ipoib_addr, ipoib_port, 1 };
+
+  uint64_t constexpr filesize = 40;// bytes
+
+  auto const [laddr, l1, lkey] = client.CreateRegion(filesize, false, false);
+  auto const [raddr, l2, rkey] = client.MmapRemoteFile(mmap_test1);
+  auto const region = client.AllocateRegion(1024);
+
+  {
+    // a second client coming and going must not disturb the first
+    FAM::FamControl other{ memserver_grpc_addr, ipoib_addr, ipoib_port, 2 };
+    auto const other_region = other.AllocateRegion(1024);
+    REQUIRE(other_region.raddr != region.raddr);
+    other.MmapRemoteFile(mmap_test1);
+  }
+
+  int volatile *p = reinterpret_cast<int volatile *>(laddr);
+  constexpr auto magic = 0x0FFFFFFF;
+  *p = magic;
+  client.Read(const_cast<int *>(p), raddr, filesize, lkey, rkey, 0);
+  while (*p == magic) {}
+  for (int i = 0; i < 10; ++i) REQUIRE(p[i] == i);
+
+  *p = magic;
+  client.Read(const_cast<int *>(p), region.raddr, 4, lkey, region.rkey, 0);
+  while (*p == magic) {}
+  REQUIRE(*p == 0);
+}
+
 TEST_CASE("rdma mmap multi-channel", "[rdma]")
 {
   constexpr auto rdma_channels = 5;
@@ -184,3 +304,112 @@ TEST_CASE("Vector Read Upper Limit of WRs")
     }
   }
 }
+
+TEST_CASE("rdma batches in flight", "[rdma]")
+{
+  FAM::FamControl client{ memserver_grpc_addr, ipoib_addr, ipoib_port, 1 };
+
+  // more work requests than fit in a channel's ring at once
+  auto const n = 2 * FAM::wr_ring_size + 3;
+  auto const [laddr, l1, lkey] =
+    client.CreateRegion(n * sizeof(int), false, false);
+  auto const [raddr, l2, rkey] = client.MmapRemoteFile(mmap_test1);
+
+  int volatile *p = reinterpret_cast<int volatile *>(laddr);
+  constexpr auto magic = 0x0FFFFFFF;
+  for (unsigned long i = 0; i < n; ++i) p[i] = magic;
+
+  // three independent batches: the first int, 10 ints, then the rest
+  std::vector<FAM::FamSegment> rest;
+  for (unsigned long i = 11; i < n; ++i)
+    rest.push_back({ raddr + sizeof(int) * (i % 10), sizeof(int) });
+
+  auto const first = client.Read(const_cast<int *>(p), raddr, 4, lkey, rkey, 0);
+  auto const second =
+    client.Read(const_cast<int *>(p) + 1, raddr, 40, lkey, rkey, 0);
+  auto const third = client.Read(const_cast<int *>(p) + 11, rest, lkey, rkey, 0);
+  client.Wait(third);
+  REQUIRE(client.IsComplete(first));
+  REQUIRE(client.IsComplete(second));
+
+  REQUIRE(p[0] == 0);
+  for (int i = 0; i < 10; ++i) REQUIRE(p[1 + i] == i);
+  for (unsigned long i = 11; i < n; ++i)
+    REQUIRE(p[i] == static_cast<int>(i % 10));
+}
+
+TEST_CASE("rdma coalesced vector read", "[rdma]")
+{
+  FAM::FamControl client{ memserver_grpc_addr, ipoib_addr, ipoib_port, 1 };
+
+  uint64_t constexpr filesize = 80000;// bytes
+  auto const [laddr, l1, lkey] = client.CreateRegion(filesize, false, false);
+  auto const [raddr, l2, rkey] = client.MmapRemoteFile(mmap_test2);
+  REQUIRE(l2 == filesize);
+
+  int volatile *p = reinterpret_cast<int volatile *>(laddr);
+  constexpr auto magic = 0x0FFFFFFF;
+  for (unsigned long i = 0; i < filesize / sizeof(int); ++i) p[i] = magic;
+
+  // 50 ints out of every 100, so every other 200 bytes are a gap
+  auto const length = 50 * sizeof(int);
+  auto const stride = 100;
+  auto const n = 150;
+  std::vector<FAM::FamSegment> v;
+  for (int i = 0; i < n; ++i)
+    v.push_back({ raddr + sizeof(int) * stride * i, length });
+
+  auto const gap = GENERATE(0U, 200U, 4096U);
+  auto policy = client.MaxCoalescePolicy();
+  policy.max_gap = gap;
+  client.Wait(client.Read(const_cast<int *>(p), v, lkey, rkey, policy, 0));
+
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < 50; ++j) REQUIRE(p[i * 50 + j] == i * stride + j);
+  }
+  REQUIRE(p[n * 50] == magic);
+}
+
+TEST_CASE("rdma io thread", "[rdma]")
+{
+  FAM::FamControl client{
+    memserver_grpc_addr, ipoib_addr, ipoib_port, 1, true
+  };
+
+  uint64_t constexpr filesize = 80000;// bytes
+  auto const [laddr, l1, lkey] = client.CreateRegion(filesize, false, false);
+  auto const [raddr, l2, rkey] = client.MmapRemoteFile(mmap_test2);
+  REQUIRE(l2 == filesize);
+
+  int volatile *p = reinterpret_cast<int volatile *>(laddr);
+  constexpr auto magic = 0x0FFFFFFF;
+  for (unsigned long i = 0; i < filesize / sizeof(int); ++i) p[i] = magic;
+
+  // submitters take turns over 25 int pieces, so adjacent pieces come from
+  // different threads; all but the last 100 ints are read
+  auto const length = 25 * sizeof(int);
+  auto const pieces = 790;
+  auto const submitters = 4;
+  std::vector<std::atomic<uint32_t>> pending(submitters);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < submitters; ++t) {
+    threads.emplace_back([&, t] {
+      auto &my_pending = pending[static_cast<std::size_t>(t)];
+      for (int i = t; i < pieces; i += submitters) {
+        auto const offset = length * static_cast<unsigned long>(i);
+        my_pending.fetch_add(1);
+        client.Submit({ static_cast<char *>(laddr) + offset,
+          raddr + offset,
+          length,
+          lkey,
+          rkey,
+          &my_pending });
+      }
+      while (my_pending.load() != 0) {}
+    });
+  }
+  for (auto &thread : threads) thread.join();
+
+  for (int i = 0; i < pieces * 25; ++i) REQUIRE(p[i] == i);
+  REQUIRE(p[pieces * 25] == magic);
+}
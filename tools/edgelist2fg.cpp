@@ -2,6 +2,7 @@
 #include <stdexcept>
 #include <vector>
 #include <utility>
+#include <tuple>
 
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
@@ -76,11 +77,13 @@ void encode_unweighted(fs::path const& p,
   po::variables_map const& vm)
 {
   bool make_undirected = vm.count("make-undirected") != 0;
+  bool transpose = vm.count("transpose") != 0;
   fs::ifstream ifs(p);
   uint32_t a, b;
   std::vector<std::pair<uint32_t, uint32_t>> v;
   uint32_t max_vert = 0;
   while (ifs >> a >> b) {
+    if (transpose) { std::swap(a, b); }
     v.push_back(std::make_pair(a, b));
     if (make_undirected) { v.push_back(std::make_pair(b, a)); }
     max_vert = std::max(max_vert, std::max(a, b));
@@ -119,6 +122,54 @@ void encode_unweighted(fs::path const& p,
   adj_ostream.close();
 }
 
+// Input lines are "src dst weight". Weights are written to their own file,
+// one uint32_t per edge in the order of the adjacency file.
+void encode_weighted(fs::path const& p,
+  fs::path const& index,
+  fs::path const& adj,
+  fs::path const& wgt,
+  po::variables_map const& vm)
+{
+  bool make_undirected = vm.count("make-undirected") != 0;
+  bool transpose = vm.count("transpose") != 0;
+  fs::ifstream ifs(p);
+  uint32_t a, b, w;
+  std::vector<std::tuple<uint32_t, uint32_t, uint32_t>> t;
+  uint32_t max_vert = 0;
+  while (ifs >> a >> b >> w) {
+    if (transpose) { std::swap(a, b); }
+    t.push_back(std::make_tuple(a, b, w));
+    if (make_undirected) { t.push_back(std::make_tuple(b, a, w)); }
+    max_vert = std::max(max_vert, std::max(a, b));
+  }
+
+  if (!vm.count("sorted")) {
+    oneapi::dpl::sort(oneapi::dpl::execution::par_unseq, t.begin(), t.end());
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> v;
+  std::vector<uint32_t> weights;
+  v.reserve(t.size());
+  weights.reserve(t.size());
+  for (auto const& [src, dst, weight] : t) {
+    v.push_back(std::make_pair(src, dst));
+    weights.push_back(weight);
+  }
+
+  csr_graph g = edge_list_to_csr(v, max_vert);
+
+  fs::ofstream index_ostream(index);
+  fs::ofstream adj_ostream(adj);
+  fs::ofstream wgt_ostream(wgt);
+  for (auto i : g.index) { index_ostream.write((char *)&i, sizeof(i)); }
+  for (auto i : g.dest) { adj_ostream.write((char *)&i, sizeof(i)); }
+  for (auto i : weights) { wgt_ostream.write((char *)&i, sizeof(i)); }
+
+  index_ostream.close();
+  adj_ostream.close();
+  wgt_ostream.close();
+}
+
 int main(int argc, char *argv[])
 {
   try {
@@ -127,7 +178,9 @@ int main(int argc, char *argv[])
       po::value<std::string>(),
       "input filepath")("outdir,o", po::value<std::string>(), "ouput dir")(
       "sorted,s", "set if input edgelist is sorted by origin vertex")(
-      "make-undirected", "add a reverse edge for each edge in the list");
+      "make-undirected", "add a reverse edge for each edge in the list")(
+      "weighted", "input lines carry an edge weight; also write a .wgt file")(
+      "transpose", "reverse every edge to list in-neighbours");
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
     po::notify(vm);
@@ -136,18 +189,24 @@ int main(int argc, char *argv[])
     std::string file = vm["infile"].as<std::string>();
     std::string outdir = vm["outdir"].as<std::string>();
     std::string outdir2 = vm["outdir"].as<std::string>();
+    std::string outdir3 = vm["outdir"].as<std::string>();
     fs::path p(file);
     fs::path p2(outdir.append(p.stem().c_str()));
     fs::path p3(outdir2.append(p.stem().c_str()));
+    fs::path p4(outdir3.append(p.stem().c_str()));
     fs::path index(p2.replace_extension(".idx"));
     fs::path adj(p3.replace_extension(".adj"));
+    fs::path wgt(p4.replace_extension(".wgt"));
 
     spdlog::info("Writing index file: {}\nWriting adj file: {}",
       index.c_str(),
       adj.c_str());
 
     if (fs::exists(p) && fs::is_regular_file(p)) {
-      encode_unweighted(p, index, adj, vm);
+      if (vm.count("weighted"))
+        encode_weighted(p, index, adj, wgt, vm);
+      else
+        encode_unweighted(p, index, adj, vm);
     } else {
       throw std::runtime_error("Input file not found");
     }